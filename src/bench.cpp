@@ -0,0 +1,463 @@
+/// @brief: This program measures how quickly the correlation function is
+///         computed, using synthetic data whose correlation function is
+///         known exactly.  It can also write that data to a file.
+///
+///  The data is generated using an AR(1) process (a discretized
+///  Ornstein-Uhlenbeck process), independently for each component:
+///
+///     x_d(i+1) = a * x_d(i) + sqrt(1-a^2) * ξ_d(i)      (a = exp(-1/τ))
+///
+///  where ξ_d(i) are independent (Gaussian) random numbers.  Each component
+///  has variance 1, and the exact correlation function is C(j) = D * a^j,
+///  so the exact correlation time is τ.
+///
+///  With "-validate", every engine (direct, fft, and auto) is timed using
+///  the same settings, to check that "auto" chooses the faster engine.
+
+
+#include <vector>
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <random>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#define _USE_MATH_DEFINES
+#include <cmath>
+using namespace std;
+#include "err.hpp"
+#include "io.hpp"
+#include "dataset.hpp"
+#include "ndautocrr.hpp"
+#ifndef DISABLE_OPENMP
+#include <omp.h>
+#endif
+
+
+
+/// @brief  Write "num_sets" data sets (separated by blank lines), each
+///         containing N entries of dimension D, generated by an AR(1)
+///         process with correlation time tau.  (Each data set begins
+///         with an entry drawn from the stationary distribution.)
+void
+GenerateAR1(ostream &out,
+            size_t N,        //!< the number of entries in each data set
+            size_t D,        //!< the number of components in each entry
+            double tau,      //!< the correlation time
+            size_t num_sets, //!< the number of data sets
+            unsigned long seed)
+{
+  mt19937_64 rng(seed);
+  normal_distribution<double> gauss(0.0, 1.0);
+  double a = exp(-1.0 / tau);
+  double b = sqrt(1.0 - a*a);
+  vector<double> x(D);
+  out.precision(9);
+  for (size_t n=0; n < num_sets; n++) {
+    if (n > 0)
+      out << "\n";
+    for (size_t d=0; d < D; d++)
+      x[d] = gauss(rng);
+    for (size_t i=0; i < N; i++) {
+      for (size_t d=0; d < D; d++) {
+        if (d > 0)
+          out << " ";
+        out << x[d];
+        x[d] = a*x[d] + b*gauss(rng);
+      }
+      out << "\n";
+    }
+  }
+} //GenerateAR1()
+
+
+
+/// @brief  Parse a comma-separated list of numbers (for example "1,10,100")
+template<typename T>
+vector<T>
+ParseList(const char *arg, const char *flag)
+{
+  vector<T> v;
+  string s(arg);
+  for (size_t k=0; k < s.size(); k++)
+    if (s[k] == ',')
+      s[k] = ' ';
+  stringstream ss(s);
+  double x;
+  while (ss >> x)
+    v.push_back(static_cast<T>(x));
+  if ((v.size() == 0) || (! ss.eof()))
+    throw InputErr(string("Error: Expected a comma-separated list of numbers following ")
+                   + flag + "\n");
+  return v;
+}
+
+
+
+/// @brief  Parse a comma-separated list of engine names (for example
+///         "direct,fft,auto").  (See NdAutocrr::Engine.)
+vector<NdAutocrr<double>::Engine>
+ParseEngines(const char *arg)
+{
+  vector<NdAutocrr<double>::Engine> v;
+  string s(arg);
+  for (size_t k=0; k < s.size(); k++)
+    if (s[k] == ',')
+      s[k] = ' ';
+  stringstream ss(s);
+  string name;
+  while (ss >> name) {
+    if (name == "direct")
+      v.push_back(NdAutocrr<double>::ENGINE_DIRECT);
+    else if (name == "fft")
+      v.push_back(NdAutocrr<double>::ENGINE_FFT);
+    else if (name == "auto")
+      v.push_back(NdAutocrr<double>::ENGINE_AUTO);
+    else
+      throw InputErr("Error: Unrecognized engine: \"" + name + "\"\n"
+                     "       (Expected \"direct\", \"fft\", or \"auto\".)\n");
+  }
+  if (v.size() == 0)
+    throw InputErr("Error: Expected a comma-separated list of engines following -engine\n");
+  return v;
+}
+
+
+/// @brief  The name of an engine
+const char *
+EngineName(NdAutocrr<double>::Engine engine)
+{
+  if (engine == NdAutocrr<double>::ENGINE_FFT)
+    return "fft";
+  else if (engine == NdAutocrr<double>::ENGINE_AUTO)
+    return "auto";
+  return "direct";
+}
+
+
+
+/// @brief  The settings and results of a single benchmark
+struct BenchResult {
+  size_t N, D, L, num_sets;
+  bool periodic, rms;
+  NdAutocrr<double>::Engine engine;
+  string chosen;         // the engine(s) actually used ("direct", "fft", "both")
+  int threads;
+  double parse_time, accumulate_time, finalize_time;
+  double megabytes;
+  double num_products;   // the number of products x(i)⋅x(i+j) computed
+  double tau_exact, tau_est;
+  double max_err;        // max_j |C(j)/C(0) - a^j|
+};
+
+
+
+/// @brief  Generate the data, then time how long it takes to parse it,
+///         to compute the sums (Accumulate()), and to normalize them
+///         (Finalize()).  Each phase is repeated "reps" times, and the
+///         fastest time is reported.
+BenchResult
+RunBenchmark(size_t N, size_t D, size_t L, size_t num_sets,
+             bool periodic, bool rms, NdAutocrr<double>::Engine engine,
+             int threads, double tau, int reps, unsigned long seed,
+             const EngineCostModel &cost_model) //!< (used by ENGINE_AUTO)
+{
+  BenchResult r;
+  r.N = N; r.D = D; r.L = L; r.num_sets = num_sets;
+  r.periodic = periodic; r.rms = rms; r.engine = engine; r.threads = threads;
+  r.tau_exact = tau;
+  r.parse_time = r.accumulate_time = r.finalize_time = HUGE_VAL;
+
+  #ifndef DISABLE_OPENMP
+  omp_set_num_threads(threads);
+  #endif
+
+  string text;
+  {
+    stringstream ss;
+    GenerateAR1(ss, N, D, tau, num_sets, seed);
+    text = ss.str();
+  }
+  r.megabytes = text.size() / 1.0e6;
+
+  for (int rep=0; rep < reps; rep++) {
+    typedef chrono::steady_clock Clock;
+
+    // parsing
+    Clock::time_point t0 = Clock::now();
+    istringstream in(text);
+    g_line = 1;
+    BufferedReader reader(in);
+    vector<DataSet<double> > vX_n(1);
+    while (reader.ReadDataSet(vX_n.back()))
+      vX_n.push_back(DataSet<double>());
+    vX_n.pop_back();
+    Clock::time_point t1 = Clock::now();
+
+    // computing the sums
+    // (The threshold 1/e is only used to estimate the correlation time,
+    //  because L is specified.)
+    NdAutocrr<double> ndautocrr(1.0 / M_E, L, periodic, true, rms, engine);
+    ndautocrr.SetCostModel(cost_model);
+    ndautocrr.Accumulate(vX_n);
+    Clock::time_point t2 = Clock::now();
+
+    // normalizing the sums
+    ndautocrr.Finalize();
+    Clock::time_point t3 = Clock::now();
+
+    r.parse_time = min(r.parse_time, chrono::duration<double>(t1-t0).count());
+    r.accumulate_time = min(r.accumulate_time,
+                            chrono::duration<double>(t2-t1).count());
+    r.finalize_time = min(r.finalize_time,
+                          chrono::duration<double>(t3-t2).count());
+
+    // Which engine(s) were used?
+    size_t num_fft = ndautocrr.NumDataSets(NdAutocrr<double>::ENGINE_FFT);
+    size_t num_direct = ndautocrr.NumDataSets(NdAutocrr<double>::ENGINE_DIRECT);
+    r.chosen = ((num_fft == 0) ? "direct" : ((num_direct == 0) ? "fft" : "both"));
+
+    // Compare with the exact correlation function
+    r.num_products = 0.0;
+    for (size_t j=0; j < ndautocrr.vNumSamples.size(); j++)
+      r.num_products += static_cast<double>(ndautocrr.vNumSamples[j]) * D;
+    r.tau_est = ndautocrr.GuessCorrelationLength();
+    double a = exp(-1.0 / tau);
+    r.max_err = 0.0;
+    for (size_t j=0; j <= ndautocrr.size(); j++)
+      r.max_err = max(r.max_err,
+                      fabs(ndautocrr.vC[j] / ndautocrr.vC[0] - pow(a, j)));
+  }
+  return r;
+} //RunBenchmark()
+
+
+
+void
+PrintCSVHeader(ostream &out)
+{
+  out << "N,D,L,sets,periodic,rms,engine,chosen,threads,"
+      << "parse_s,accumulate_s,finalize_s,parse_MB_per_s,products_per_s,"
+      << "tau_exact,tau_est,max_err_C\n";
+}
+
+void
+PrintCSV(ostream &out, const BenchResult &r)
+{
+  out << r.N << "," << r.D << "," << r.L << "," << r.num_sets << ","
+      << r.periodic << "," << r.rms << "," << EngineName(r.engine) << ","
+      << r.chosen << "," << r.threads << ","
+      << r.parse_time << "," << r.accumulate_time << "," << r.finalize_time << ","
+      << r.megabytes / r.parse_time << ","
+      << r.num_products / r.accumulate_time << ","
+      << r.tau_exact << "," << r.tau_est << "," << r.max_err << "\n";
+}
+
+void
+PrintJSON(ostream &out, const BenchResult &r, bool first)
+{
+  out << (first ? "[\n" : ",\n")
+      << "  {\"N\": " << r.N << ", \"D\": " << r.D << ", \"L\": " << r.L
+      << ", \"sets\": " << r.num_sets
+      << ", \"periodic\": " << (r.periodic ? "true" : "false")
+      << ", \"rms\": " << (r.rms ? "true" : "false")
+      << ", \"engine\": \"" << EngineName(r.engine) << "\""
+      << ", \"chosen\": \"" << r.chosen << "\""
+      << ", \"threads\": " << r.threads
+      << ",\n   \"parse_s\": " << r.parse_time
+      << ", \"accumulate_s\": " << r.accumulate_time
+      << ", \"finalize_s\": " << r.finalize_time
+      << ", \"parse_MB_per_s\": " << r.megabytes / r.parse_time
+      << ", \"products_per_s\": " << r.num_products / r.accumulate_time
+      << ",\n   \"tau_exact\": " << r.tau_exact
+      << ", \"tau_est\": " << r.tau_est
+      << ", \"max_err_C\": " << r.max_err << "}";
+}
+
+
+
+/// @brief  Compare the time needed by "auto" with the time needed by the
+///         faster of the other two engines (using the same settings).
+///         Returns the ratio.  (*pChoseFastest is set to true if "auto"
+///         chose the faster engine.)
+double
+PrintValidation(ostream &out,
+                const BenchResult &r_direct,
+                const BenchResult &r_fft,
+                const BenchResult &r_auto,
+                bool first,
+                bool *pChoseFastest)
+{
+  const BenchResult &r = r_auto;
+  double t_best = min(r_direct.accumulate_time, r_fft.accumulate_time);
+  const char *best = ((r_direct.accumulate_time <= r_fft.accumulate_time)
+                      ? "direct" : "fft");
+  double ratio = r_auto.accumulate_time / t_best;
+  *pChoseFastest = (r_auto.chosen == best);
+  if (first)
+    out << "N,D,L,sets,periodic,rms,threads,"
+        << "direct_s,fft_s,auto_s,auto_chose,fastest,auto_over_fastest\n";
+  out << r.N << "," << r.D << "," << r.L << "," << r.num_sets << ","
+      << r.periodic << "," << r.rms << "," << r.threads << ","
+      << r_direct.accumulate_time << "," << r_fft.accumulate_time << ","
+      << r_auto.accumulate_time << "," << r_auto.chosen << "," << best << ","
+      << ratio << "\n";
+  return ratio;
+}
+
+
+
+int
+main(int argc, char **argv)
+{
+  try {
+    // the values of each parameter to try (all combinations are used)
+    vector<size_t> vN(1, 1000000);
+    vector<size_t> vD(1, 3);
+    vector<size_t> vL(1, 100);
+    vector<size_t> vSets(1, 1);
+    vector<int> vPeriodic(1, 0);
+    vector<int> vRms(1, 0);
+    vector<NdAutocrr<double>::Engine> vEngines(1, NdAutocrr<double>::ENGINE_DIRECT);
+    vector<int> vThreads(1, 1);
+    #ifndef DISABLE_OPENMP
+    vThreads[0] = omp_get_max_threads();
+    #endif
+    double tau = 20.0;
+    int reps = 3;
+    unsigned long seed = 1;
+    bool json = false;
+    bool generate = false;
+    bool validate = false;     // compare "auto" with the other engines?
+
+    for (int i=1; i < argc; i++) {
+      bool has_arg = (i+1 < argc);
+      if ((strcmp(argv[i], "-json")==0) || (strcmp(argv[i], "-csv")==0))
+        json = (strcmp(argv[i], "-json")==0);
+      else if (strcmp(argv[i], "-gen")==0)
+        generate = true;
+      else if (strcmp(argv[i], "-validate")==0)
+        validate = true;
+      else if (! has_arg)
+        throw InputErr(string("Error: Unrecognized argument (or missing value): \"")
+                       + argv[i] + "\"\n");
+      else if (strcmp(argv[i], "-N")==0)
+        vN = ParseList<size_t>(argv[++i], "-N");
+      else if (strcmp(argv[i], "-D")==0)
+        vD = ParseList<size_t>(argv[++i], "-D");
+      else if (strcmp(argv[i], "-L")==0)
+        vL = ParseList<size_t>(argv[++i], "-L");
+      else if (strcmp(argv[i], "-sets")==0)
+        vSets = ParseList<size_t>(argv[++i], "-sets");
+      else if (strcmp(argv[i], "-periodic")==0)
+        vPeriodic = ParseList<int>(argv[++i], "-periodic");
+      else if (strcmp(argv[i], "-rms")==0)
+        vRms = ParseList<int>(argv[++i], "-rms");
+      else if (strcmp(argv[i], "-fft")==0) {
+        // (an older way to choose the engines: 0 = direct, 1 = fft)
+        vector<int> vFFT = ParseList<int>(argv[++i], "-fft");
+        vEngines.clear();
+        for (size_t k=0; k < vFFT.size(); k++)
+          vEngines.push_back(vFFT[k]
+                             ? NdAutocrr<double>::ENGINE_FFT
+                             : NdAutocrr<double>::ENGINE_DIRECT);
+      }
+      else if (strcmp(argv[i], "-engine")==0)
+        vEngines = ParseEngines(argv[++i]);
+      else if (strcmp(argv[i], "-threads")==0)
+        vThreads = ParseList<int>(argv[++i], "-threads");
+      else if (strcmp(argv[i], "-tau")==0)
+        tau = ParseList<double>(argv[++i], "-tau")[0];
+      else if (strcmp(argv[i], "-reps")==0)
+        reps = ParseList<int>(argv[++i], "-reps")[0];
+      else if (strcmp(argv[i], "-seed")==0)
+        seed = ParseList<unsigned long>(argv[++i], "-seed")[0];
+      else
+        throw InputErr(string("Error: Unrecognized argument: \"") + argv[i] + "\"\n");
+    }
+    if ((tau <= 0.0) || (reps < 1))
+      throw InputErr("Error: -tau and -reps must be positive.\n");
+
+    if (generate) {
+      // Write the data to the standard output (instead of timing anything)
+      GenerateAR1(cout, vN[0], vD[0], tau, vSets[0], seed);
+      return 0;
+    }
+
+    #ifdef DISABLE_OPENMP
+    if ((vThreads.size() > 1) || (vThreads[0] != 1))
+      cerr << "Warning: OpenMP is disabled, so only 1 thread will be used.\n";
+    vThreads.assign(1, 1);
+    #endif
+
+    if (validate) {
+      vEngines.clear();
+      vEngines.push_back(NdAutocrr<double>::ENGINE_DIRECT);
+      vEngines.push_back(NdAutocrr<double>::ENGINE_FFT);
+      vEngines.push_back(NdAutocrr<double>::ENGINE_AUTO);
+      json = false;
+    }
+    // (The cost model is only needed by "auto".  See NdAutocrr::LoadCostModel().)
+    EngineCostModel cost_model;
+    if (find(vEngines.begin(), vEngines.end(),
+             NdAutocrr<double>::ENGINE_AUTO) != vEngines.end())
+      cost_model = NdAutocrr<double>::LoadCostModel(cerr);
+
+    if (! (json || validate))
+      PrintCSVHeader(cout);
+    bool first = true;
+    size_t num_cases = 0;       // (these are only used by "-validate")
+    size_t num_correct = 0;     // ("auto" chose the faster engine)
+    double worst_ratio = 0.0;
+    for (size_t iN=0; iN < vN.size(); iN++)
+    for (size_t iD=0; iD < vD.size(); iD++)
+    for (size_t iL=0; iL < vL.size(); iL++)
+    for (size_t iS=0; iS < vSets.size(); iS++)
+    for (size_t iP=0; iP < vPeriodic.size(); iP++)
+    for (size_t iR=0; iR < vRms.size(); iR++)
+    for (size_t iT=0; iT < vThreads.size(); iT++) {
+      if (vL[iL] >= vN[iN])
+        continue;
+      if (validate) {
+        vector<BenchResult> vR;
+        for (size_t iE=0; iE < vEngines.size(); iE++)
+          vR.push_back(RunBenchmark(vN[iN], vD[iD], vL[iL], vSets[iS],
+                                    vPeriodic[iP], vRms[iR], vEngines[iE],
+                                    vThreads[iT], tau, reps, seed, cost_model));
+        bool chose_fastest;
+        double ratio = PrintValidation(cout, vR[0], vR[1], vR[2], first,
+                                       &chose_fastest);
+        cout.flush();
+        first = false;
+        num_cases++;
+        if (chose_fastest)
+          num_correct++;
+        worst_ratio = max(worst_ratio, ratio);
+        continue;
+      }
+      for (size_t iE=0; iE < vEngines.size(); iE++) {
+        BenchResult r = RunBenchmark(vN[iN], vD[iD], vL[iL], vSets[iS],
+                                     vPeriodic[iP], vRms[iR], vEngines[iE],
+                                     vThreads[iT], tau, reps, seed, cost_model);
+        if (json)
+          PrintJSON(cout, r, first);
+        else
+          PrintCSV(cout, r);
+        cout.flush();
+        first = false;
+      }
+    }
+    if (validate && (num_cases > 0))
+      cerr << "# auto chose the fastest engine in " << num_correct
+           << " of " << num_cases << " cases (worst case: auto took "
+           << worst_ratio << " times as long as the fastest engine)\n";
+    if (json)
+      cout << (first ? "[]\n" : "\n]\n");
+  }
+  catch (const std::exception& e) {
+    cerr << "\n" << e.what() << endl;
+    exit(1);
+  }
+}
@@ -0,0 +1,315 @@
+///   @file binary_io.hpp
+///   @brief  Read data sets from binary files (raw float32/float64 arrays,
+///           or NumPy ".npy" files) by mapping them into memory.
+///           The numbers are used directly from the mapped pages
+///           (they are not parsed or copied).
+
+#ifndef _BINARY_IO_HPP
+#define _BINARY_IO_HPP
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+using namespace std;
+#include "err.hpp"
+#include "dataset.hpp"
+#include "io.hpp"
+
+
+
+/// @brief  A read-only memory-mapped file.
+///         (The file is unmapped when this object is destroyed.)
+
+class MappedFile {
+
+  int fd;
+  const char *pBegin;
+  size_t num_bytes;
+
+  MappedFile(const MappedFile &);             //(not copyable)
+  MappedFile &operator = (const MappedFile &);
+
+public:
+
+  MappedFile(const string &filename):fd(-1), pBegin(nullptr), num_bytes(0)
+  {
+    fd = open(filename.c_str(), O_RDONLY);
+    struct stat file_info;
+    if ((fd < 0) || (fstat(fd, &file_info) != 0)) {
+      if (fd >= 0)
+        close(fd);
+      throw InputErr("Error: Unable to open file \"" + filename + "\"\n");
+    }
+    num_bytes = file_info.st_size;
+    if (num_bytes > 0) {
+      void *p = mmap(nullptr, num_bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p == MAP_FAILED) {
+        close(fd);
+        throw InputErr("Error: Unable to map file \"" + filename + "\" into memory\n");
+      }
+      madvise(p, num_bytes, MADV_SEQUENTIAL);
+      pBegin = static_cast<const char*>(p);
+    }
+  }
+
+  ~MappedFile() {
+    if (pBegin)
+      munmap(const_cast<char*>(pBegin), num_bytes);
+    if (fd >= 0)
+      close(fd);
+  }
+
+  const char *data() const { return pBegin; }
+  size_t size() const { return num_bytes; }
+
+}; //class MappedFile
+
+
+
+/// @brief  The contents of a binary file, interpreted as a 2-dimensional
+///         array of floating point numbers (N rows and D columns).
+///         (Only one of pFloat32 or pFloat64 is non-null.)
+
+struct BinaryArray {
+  const float  *pFloat32;
+  const double *pFloat64;
+  size_t N;
+  size_t D;
+  bool column_major;  // (true for ".npy" files with fortran_order: True)
+
+  BinaryArray():pFloat32(nullptr), pFloat64(nullptr), N(0), D(0),
+                column_major(false) {}
+
+  template<typename T>
+  DataView<T> view() const;
+};
+
+template<>
+inline DataView<float> BinaryArray::view<float>() const {
+  return column_major ? DataView<float>(pFloat32, N, D, 1, N)
+                      : DataView<float>(pFloat32, N, D, D, 1);
+}
+
+template<>
+inline DataView<double> BinaryArray::view<double>() const {
+  return column_major ? DataView<double>(pFloat64, N, D, 1, N)
+                      : DataView<double>(pFloat64, N, D, D, 1);
+}
+
+
+
+/// @brief  Is this computer little-endian?
+inline bool
+IsLittleEndian()
+{
+  uint16_t x = 1;
+  unsigned char c;
+  memcpy(&c, &x, 1);
+  return c == 1;
+}
+
+
+
+/// @brief  Interpret the contents of a memory-mapped file as a raw array of
+///         little-endian floating point numbers (with D numbers per entry).
+inline BinaryArray
+ReadRawArray(const MappedFile &file,
+             size_t bytes_per_number, //!< 4 (float32) or 8 (float64)
+             size_t D,                //!< the number of columns
+             const string &filename)  //!< (for error messages)
+{
+  if (! IsLittleEndian())
+    throw InputErr("Error: Binary input files require a little-endian CPU.\n");
+  assert((bytes_per_number == 4) || (bytes_per_number == 8));
+  if ((D == 0) || (file.size() % (bytes_per_number * D) != 0)) {
+    stringstream err_msg;
+    err_msg << "Error: The size of file \"" << filename << "\" ("
+            << file.size() << " bytes) is not a multiple of "
+            << bytes_per_number * D << " bytes\n"
+            << "       (" << D << " numbers per entry, "
+            << bytes_per_number << " bytes per number).\n";
+    throw InputErr(err_msg.str());
+  }
+  BinaryArray a;
+  a.N = file.size() / (bytes_per_number * D);
+  a.D = D;
+  if (bytes_per_number == 4)
+    a.pFloat32 = reinterpret_cast<const float*>(file.data());
+  else
+    a.pFloat64 = reinterpret_cast<const double*>(file.data());
+  return a;
+}
+
+
+
+/// @brief  Interpret the contents of a memory-mapped NumPy ".npy" file.
+///         The array must contain float32 ('<f4') or float64 ('<f8') numbers,
+///         and have shape (N,), (N, D), or (K, N, D).
+///         (In the last case, the file contains K data sets of equal length,
+///          and the offset of each data set is appended to "vOffsets".)
+inline BinaryArray
+ReadNpyArray(const MappedFile &file,
+             const string &filename,   //!< (for error messages)
+             vector<size_t> &vOffsets) //!< the first entry of each data set
+{
+  const char *p = file.data();
+  string err_prefix = "Error in NumPy file \"" + filename + "\":\n       ";
+  if ((file.size() < 10) || (memcmp(p, "\x93NUMPY", 6) != 0))
+    throw InputErr(err_prefix + "The file does not begin with \"\\x93NUMPY\".\n");
+  if (! IsLittleEndian())
+    throw InputErr("Error: Binary input files require a little-endian CPU.\n");
+
+  // The header is a python dictionary (stored as text), for example:
+  // {'descr': '<f8', 'fortran_order': False, 'shape': (1000, 3), }
+  unsigned major_version = static_cast<unsigned char>(p[6]);
+  size_t header_len;
+  size_t header_start;
+  if (major_version == 1) {
+    header_len = (static_cast<unsigned char>(p[8]) |
+                  (static_cast<unsigned char>(p[9]) << 8));
+    header_start = 10;
+  }
+  else {
+    if (file.size() < 12)
+      throw InputErr(err_prefix + "The header is truncated.\n");
+    header_len = 0;
+    for (int k=3; k >= 0; k--)
+      header_len = (header_len << 8) | static_cast<unsigned char>(p[8+k]);
+    header_start = 12;
+  }
+  if (header_start + header_len > file.size())
+    throw InputErr(err_prefix + "The header is truncated.\n");
+  string header(p + header_start, header_len);
+  size_t data_start = header_start + header_len;
+
+  // Find the value corresponding to a given key in the dictionary
+  auto lookup = [&](const string &key) -> string {
+    size_t pos = header.find("'" + key + "'");
+    if (pos == string::npos)
+      throw InputErr(err_prefix + "The header lacks a \"" + key + "\" entry.\n");
+    pos = header.find(':', pos);
+    if (pos == string::npos)
+      throw InputErr(err_prefix + "Unable to parse the header.\n");
+    pos = header.find_first_not_of(" ", pos+1);
+    if (pos == string::npos)
+      throw InputErr(err_prefix + "Unable to parse the header.\n");
+    size_t stop;
+    if (header[pos] == '(')
+      stop = header.find(')', pos);
+    else if (header[pos] == '\'')
+      stop = header.find('\'', pos+1);
+    else
+      stop = header.find_first_of(",}", pos);
+    if (stop == string::npos)
+      throw InputErr(err_prefix + "Unable to parse the header.\n");
+    if ((header[pos] == '(') || (header[pos] == '\''))
+      stop++;  // (include the closing parenthesis or quote)
+    return header.substr(pos, stop - pos);
+  };
+
+  string descr = lookup("descr");
+  size_t bytes_per_number;
+  if ((descr == "'<f4'") || (descr == "'=f4'"))
+    bytes_per_number = 4;
+  else if ((descr == "'<f8'") || (descr == "'=f8'"))
+    bytes_per_number = 8;
+  else
+    throw InputErr(err_prefix + "Unsupported data type: " + descr + "\n"
+                   "       (Only little-endian float32 ('<f4') and float64 ('<f8') are supported.)\n");
+
+  bool fortran_order = (lookup("fortran_order") == "True");
+
+  // parse the shape, for example "(1000, 3)"
+  vector<size_t> shape;
+  {
+    string s = lookup("shape");
+    for (size_t k=0; k < s.size(); k++)
+      if ((s[k] == '(') || (s[k] == ')') || (s[k] == ','))
+        s[k] = ' ';
+    stringstream ss(s);
+    size_t n;
+    while (ss >> n)
+      shape.push_back(n);
+  }
+  if ((shape.size() < 1) || (shape.size() > 3))
+    throw InputErr(err_prefix + "The array must have 1, 2, or 3 dimensions.\n");
+  if ((shape.size() == 3) && fortran_order)
+    throw InputErr(err_prefix + "3-dimensional arrays must be stored in C order.\n");
+
+  BinaryArray a;
+  size_t K = 1;   // the number of data sets
+  if (shape.size() == 3) {
+    K = shape[0];
+    a.N = K * shape[1];
+    a.D = shape[2];
+    for (size_t k=0; k < K; k++)
+      vOffsets.push_back(k * shape[1]);
+  }
+  else {
+    a.N = shape[0];
+    a.D = (shape.size() == 2) ? shape[1] : 1;
+  }
+  a.column_major = fortran_order && (a.D > 1);
+
+  if (data_start + a.N * a.D * bytes_per_number > file.size())
+    throw InputErr(err_prefix + "The file is shorter than the array's shape implies.\n");
+
+  if (bytes_per_number == 4)
+    a.pFloat32 = reinterpret_cast<const float*>(p + data_start);
+  else
+    a.pFloat64 = reinterpret_cast<const double*>(p + data_start);
+  return a;
+} //ReadNpyArray()
+
+
+
+/// @brief  Read an "index file", which stores the location (row number)
+///         of the first entry in each data set (whitespace-delimited text).
+///         Data sets always begin at row 0 (whether or not 0 is listed).
+inline void
+ReadIndexFile(const string &filename,
+              vector<size_t> &vOffsets)
+{
+  ifstream f(filename.c_str());
+  if (! f)
+    throw InputErr("Error: Unable to open file \"" + filename + "\"\n");
+  long long line = 1;
+  BufferedReader reader(f, (1 << 16), &filename, &line);
+  while (reader.StreamDataSet<double>([&](const double *aX_d, size_t D) {
+        for (size_t d=0; d < D; d++) {
+          if ((aX_d[d] < 0) || (aX_d[d] != static_cast<size_t>(aX_d[d])))
+            throw InputErr("Error in index file \"" + filename + "\":\n"
+                           "       Expected a non-negative integer.\n");
+          vOffsets.push_back(static_cast<size_t>(aX_d[d]));
+        }
+      }) > 0);
+}
+
+
+
+/// @brief  Convert a list of offsets (the first row of each data set)
+///         into a sorted list of boundaries:
+///         data set k spans rows vBounds[k] <= i < vBounds[k+1]
+inline vector<size_t>
+DataSetBoundaries(vector<size_t> vOffsets, size_t N)
+{
+  vOffsets.push_back(0);
+  vOffsets.push_back(N);
+  sort(vOffsets.begin(), vOffsets.end());
+  vOffsets.erase(unique(vOffsets.begin(), vOffsets.end()), vOffsets.end());
+  if (vOffsets.back() > N)
+    throw InputErr("Error: The index file refers to rows beyond the end of the data.\n");
+  return vOffsets;
+}
+
+
+
+#endif //#ifndef _BINARY_IO_HPP
@@ -0,0 +1,303 @@
+///   @file dataset.hpp
+///   @brief  A contiguous (flat) array storing a single data set
+///           (a series of N data points, each of which is a vector of
+///           dimension D), and a lightweight (non-owning) view of data
+///           stored elsewhere in memory.
+
+#ifndef _DATASET_HPP
+#define _DATASET_HPP
+
+#include <vector>
+#include <cassert>
+#include <utility>
+#include <algorithm>
+using namespace std;
+#include "err.hpp"
+
+
+
+/// @brief  A DataView refers to a data set stored elsewhere in memory
+///         (for example, in a memory-mapped file) without copying it.
+///         Entry x_d(i) is located at aX[i*row_stride + d*col_stride].
+///         (Row-major data has row_stride=D, col_stride=1.
+///          Column-major data has row_stride=1, col_stride=N.)
+
+template<typename T>
+
+struct DataView {
+  const T *aX;
+  size_t N;           //number of entries (rows)
+  size_t D;           //number of components per entry (columns)
+  size_t row_stride;  //distance between x_d(i) and x_d(i+1)
+  size_t col_stride;  //distance between x_d(i) and x_{d+1}(i)
+
+  DataView(const T *_aX = nullptr,
+           size_t _N = 0,
+           size_t _D = 0,
+           size_t _row_stride = 0,  //(0 means D)
+           size_t _col_stride = 1):
+    aX(_aX), N(_N), D(_D),
+    row_stride(_row_stride == 0 ? _D : _row_stride),
+    col_stride(_col_stride)
+  {}
+
+  size_t size() const { return N; }
+  size_t dim() const { return D; }
+  bool empty() const { return N == 0; }
+
+  const T &operator()(size_t i, size_t d) const {
+    return aX[i*row_stride + d*col_stride];
+  }
+
+  /// @brief  Return a view of the entries i_begin <= i < i_end
+  DataView Slice(size_t i_begin, size_t i_end) const {
+    assert((i_begin <= i_end) && (i_end <= N));
+    return DataView(aX + i_begin*row_stride, i_end - i_begin, D,
+                    row_stride, col_stride);
+  }
+}; //struct DataView
+
+
+
+/// @brief  A DataSet stores N entries (x(0), x(1), ... x(N-1)), each of
+///         which is a vector of dimension D, in a single contiguous array.
+///         By default the entries are stored in row-major order
+///         (x_d(i) is located at aX[i*D + d]), so that consecutive entries
+///         are adjacent in memory.  The data can also be rearranged into
+///         column-major order (x_d(i) is located at aX[d*N + i]), so that
+///         each component (column) is contiguous.
+
+template<typename Scalar>
+
+class DataSet {
+
+public:
+
+  enum Layout {
+    ROW_MAJOR,    //!< x_d(i) is stored in aX[i*D + d]
+    COLUMN_MAJOR  //!< x_d(i) is stored in aX[d*N + i]
+  };
+
+private:
+
+  size_t N;         //number of entries (rows)
+  size_t D;         //number of components per entry (columns)
+  Layout layout;
+  vector<Scalar> aX;
+
+public:
+
+  DataSet(size_t _D = 0):N(0), D(_D), layout(ROW_MAJOR) {}
+
+  /// @brief  Copy the contents of a (less efficient) nested vector.
+  DataSet(const vector<vector<Scalar> > &vvX_id):N(0), D(0), layout(ROW_MAJOR)
+  {
+    if (vvX_id.size() > 0)
+      aX.reserve(vvX_id.size() * vvX_id[0].size());
+    for (size_t i=0; i < vvX_id.size(); i++)
+      push_back(vvX_id[i]);
+  }
+
+  /// @brief  Return the number of entries (rows) in the data set
+  size_t size() const { return N; }
+
+  /// @brief  Return the dimension of each entry (number of columns)
+  size_t dim() const { return D; }
+
+  bool empty() const { return N == 0; }
+
+  Layout GetLayout() const { return layout; }
+
+  /// @brief  Discard the contents (but keep the memory allocated)
+  void clear() {
+    N = 0;
+    D = 0;
+    layout = ROW_MAJOR;
+    aX.clear();
+  }
+
+  void reserve(size_t n_rows) { aX.reserve(n_rows * D); }
+
+  /// @brief  Append a new entry x(N) to the end of the data set.
+  ///         (Only possible in ROW_MAJOR order.)
+  ///         All entries must have the same number of components.
+  void push_back(const Scalar *aXnew, size_t d_new) {
+    assert(layout == ROW_MAJOR);
+    if (N == 0)
+      D = d_new;
+    else if (d_new != D)
+      throw InputErr("Error: Inconsistent number of entries on each line.\n");
+    aX.insert(aX.end(), aXnew, aXnew + d_new);
+    N++;
+  }
+
+  void push_back(const vector<Scalar> &vXnew) {
+    push_back(vXnew.data(), vXnew.size());
+  }
+
+  /// @brief  Access x_d(i)  (regardless of the layout)
+  Scalar &operator()(size_t i, size_t d) {
+    return (layout == ROW_MAJOR) ? aX[i*D + d] : aX[d*N + i];
+  }
+  const Scalar &operator()(size_t i, size_t d) const {
+    return (layout == ROW_MAJOR) ? aX[i*D + d] : aX[d*N + i];
+  }
+
+  /// @brief  Return a pointer to x(i)  (ROW_MAJOR order only)
+  Scalar *row(size_t i) { assert(layout == ROW_MAJOR); return &aX[i*D]; }
+  const Scalar *row(size_t i) const {
+    assert(layout == ROW_MAJOR);
+    return &aX[i*D];
+  }
+
+  /// @brief  Return a pointer to x_d(0)  (COLUMN_MAJOR order only)
+  Scalar *column(size_t d) { assert(layout == COLUMN_MAJOR); return &aX[d*N]; }
+  const Scalar *column(size_t d) const {
+    assert(layout == COLUMN_MAJOR);
+    return &aX[d*N];
+  }
+
+  /// @brief  Return a pointer to the underlying contiguous array.
+  Scalar *data() { return aX.data(); }
+  const Scalar *data() const { return aX.data(); }
+
+  /// @brief  Return a (non-owning) view of this data set
+  DataView<Scalar> view() const {
+    if (layout == ROW_MAJOR)
+      return DataView<Scalar>(aX.data(), N, D, D, 1);
+    else
+      return DataView<Scalar>(aX.data(), N, D, 1, N);
+  }
+
+  /// @brief  Move the underlying array into aDest (without copying it),
+  ///         leaving this data set empty.  (The layout of the array is
+  ///         GetLayout().)
+  void Release(vector<Scalar> &aDest) {
+    aDest = std::move(aX);
+    aX = vector<Scalar>();
+    N = 0;
+    D = 0;
+    layout = ROW_MAJOR;
+  }
+
+  /// @brief  Rearrange the data in memory using the requested layout.
+  ///         If in_place==true, then no additional copy of the data is
+  ///         made (at most one column is copied), but this is slower.
+  void SetLayout(Layout new_layout, bool in_place = false) {
+    if ((new_layout == layout) || (D <= 1)) {
+      layout = new_layout;
+      return;
+    }
+    if (in_place) {
+      if ((new_layout == COLUMN_MAJOR) && (D <= max_peel_columns))
+        PeelColumns();
+      else
+        TransposeInPlace();
+      layout = new_layout;
+      return;
+    }
+    vector<Scalar> aXnew(aX.size());
+    for (size_t i=0; i < N; i++) {
+      for (size_t d=0; d < D; d++) {
+        if (new_layout == COLUMN_MAJOR)
+          aXnew[d*N + i] = aX[i*D + d];
+        else
+          aXnew[i*D + d] = aX[d*N + i];
+      }
+    }
+    aX.swap(aXnew);
+    layout = new_layout;
+  }
+
+  /// @brief  Calculate the average value of each component, ⟨x_d⟩
+  void Average(vector<Scalar> &x_ave) const {
+    x_ave.assign(D, 0.0);
+    if (N == 0)
+      return;
+    if (layout == ROW_MAJOR) {
+      const Scalar *px = aX.data();
+      for (size_t i=0; i < N; i++, px += D)
+        for (size_t d=0; d < D; d++)
+          x_ave[d] += px[d];
+    }
+    else {
+      for (size_t d=0; d < D; d++) {
+        const Scalar *px = &aX[d*N];
+        for (size_t i=0; i < N; i++)
+          x_ave[d] += px[i];
+      }
+    }
+    for (size_t d=0; d < D; d++)
+      x_ave[d] /= N;
+  }
+
+  /// @brief  Subtract x_shift from every entry:  x(i) -> x(i) - x_shift
+  void Subtract(const vector<Scalar> &x_shift) {
+    assert(x_shift.size() == D);
+    if (layout == ROW_MAJOR) {
+      Scalar *px = aX.data();
+      for (size_t i=0; i < N; i++, px += D)
+        for (size_t d=0; d < D; d++)
+          px[d] -= x_shift[d];
+    }
+    else {
+      for (size_t d=0; d < D; d++) {
+        Scalar *px = &aX[d*N];
+        for (size_t i=0; i < N; i++)
+          px[i] -= x_shift[d];
+      }
+    }
+  }
+
+private:
+
+  // (PeelColumns() needs D passes over the data, so it is only used when
+  //  there are few columns.  TransposeInPlace() accesses memory randomly.)
+  static const size_t max_peel_columns = 16;
+
+  /// @brief  Rearrange the data from row-major to column-major order,
+  ///         one column at a time (beginning with the last column):  The
+  ///         column is copied to a temporary array, the remaining columns
+  ///         are moved forward, and then the column is stored at the end.
+  void PeelColumns() {
+    vector<Scalar> aColumn(N);
+    for (size_t C=D; C > 1; C--) {
+      // (The first C columns are stored in aX[0, N*C) in row-major order.)
+      for (size_t i=0; i < N; i++)
+        aColumn[i] = aX[i*C + (C-1)];
+      for (size_t i=1; i < N; i++)
+        for (size_t d=0; d+1 < C; d++)
+          aX[i*(C-1) + d] = aX[i*C + d];
+      copy(aColumn.begin(), aColumn.end(), &aX[(C-1)*N]);
+    }
+  }
+
+  /// @brief  Transpose the (R x C) matrix stored in aX (in row-major order)
+  ///         by following the cycles of the permutation  r*C+c -> c*R+r.
+  ///         (Only one bit per entry is needed to keep track of the entries
+  ///          which have been moved.)
+  void TransposeInPlace() {
+    size_t R = (layout == ROW_MAJOR) ? N : D;  // the number of rows
+    size_t C = (layout == ROW_MAJOR) ? D : N;  // the number of columns
+    size_t size = R*C;
+    vector<bool> moved(size, false);
+    // (The first and last entries never move.)
+    for (size_t start=1; start+1 < size; start++) {
+      if (moved[start])
+        continue;
+      Scalar x = aX[start];
+      size_t k = start;
+      do {
+        size_t k_dest = (k % C) * R + (k / C);
+        swap(x, aX[k_dest]);
+        moved[k_dest] = true;
+        k = k_dest;
+      } while (k != start);
+    }
+  }
+
+}; //class DataSet
+
+
+
+#endif //#ifndef _DATASET_HPP
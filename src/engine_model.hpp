@@ -0,0 +1,212 @@
+///   @file engine_model.hpp
+///   @brief  Estimate how long each method ("engine") would need to compute
+///           the correlation function, so that the faster one can be chosen
+///           automatically.  (See the "-engine" argument.)
+
+#ifndef _ENGINE_MODEL_HPP
+#define _ENGINE_MODEL_HPP
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <cstdlib>
+#include <cmath>
+#include <cstdio>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "fft.hpp"
+using namespace std;
+
+
+
+/// @brief  An EngineCostModel predicts the time needed by each engine:
+///
+///    direct:  (number of products x_d(i)*x_d(i+j)) * direct_product / threads
+///    fft:     (number of transforms) * M*log2(M) * fft_point(M)
+///
+///         where M = NextPow2(2N) is the size of each (complex) transform.
+///         (The FFT engine uses a single thread.)  Large transforms do not fit
+///         in the CPU's cache, so fft_point(M) is measured for a small and a
+///         large M, and interpolated (linearly in log2(M)) between them
+///         (and extrapolated beyond them).  The coefficients depend
+///         on the computer, so they are measured once (by a short benchmark,
+///         see NdAutocrr::CalibrateEngines()) and then stored in a small
+///         text file (see CacheFilename()).  Until then, rough guesses are
+///         used instead.  (They are only measured when the amount of
+///         computation is large enough for the choice to matter.  See
+///         min_calibration_cost.)
+
+class EngineCostModel {
+
+public:
+
+  double direct_product;     // seconds per product (using one thread)
+  double direct_product_rms; // (the same, when the rms is also calculated)
+  double fft_point_small;    // seconds per M*log2(M) (when M = 2^log2_M_small)
+  double fft_point_large;    // seconds per M*log2(M) (when M = 2^log2_M_large)
+  string source;             // where did these numbers come from? (""=guess)
+
+  // the sizes of the transforms used to measure fft_point_small and _large
+  static constexpr size_t log2_M_small = 13;
+  static constexpr size_t log2_M_large = 20;
+
+  // Measuring these parameters takes about half a second, so it is only
+  // worthwhile if the faster engine is predicted to need at least this long
+  // (in seconds).  Until then, the guesses are used.
+  static constexpr double min_calibration_cost = 0.25;
+
+  EngineCostModel():
+    direct_product(1.0e-9),
+    direct_product_rms(2.0e-9),
+    fft_point_small(5.0e-9),
+    fft_point_large(1.0e-8)
+  { }
+
+  /// @brief  The predicted time needed by the direct engine
+  double DirectCost(double num_products, //!< products x_d(i)*x_d(i+j)
+                    bool rms,            //!< also compute the rms?
+                    size_t num_threads = 1) const
+  {
+    if (num_threads < 1)
+      num_threads = 1;
+    return num_products * (rms ? direct_product_rms : direct_product)
+      / num_threads;
+  }
+
+  /// @brief  The predicted time needed by the FFT engine
+  double FFTCost(size_t N,                //!< the length of each series
+                 double num_transforms) const //!< the number of transforms
+  {
+    if (N == 0)
+      return 0.0;
+    double M = NextPow2(2*N);
+    return num_transforms * M * log2(M) * FFTPoint(log2(M));
+  }
+
+  /// @brief  The time per M*log2(M) for each transform of size M
+  double FFTPoint(double log2_M) const {
+    if (log2_M <= log2_M_small)
+      return fft_point_small;
+    double slope = ((fft_point_large - fft_point_small) /
+                    (log2_M_large - log2_M_small));
+    double c = fft_point_small + slope * (log2_M - log2_M_small);
+    return (c > 0.0) ? c : fft_point_small;
+  }
+
+  /// @brief  The number of transforms needed by AutoCorrelateFFT()
+  ///         to compute the (summed) autocorrelation of num_series series.
+  static double AutoTransforms(size_t num_series) {
+    return (num_series == 0) ? 0.0 : (num_series + 1) / 2 + 1;
+  }
+
+  /// @brief  The number of transforms needed by CrossCorrelateFFT()
+  ///         to compute the correlations of P pairs (from D series).
+  static double CrossTransforms(size_t D, size_t P) {
+    return (P == 0) ? 0.0 : (D + 1) / 2 + (P + 1) / 2;
+  }
+
+  /// @brief  The name used for the parameters measured using this
+  ///         floating point type (and these compiler settings).
+  ///         (Different builds of this program can share the same file.)
+  static string Key(size_t scalar_bytes) {
+    stringstream key;
+    key << "float" << 8*scalar_bytes;
+    #if defined(__AVX__)
+    key << "-avx";
+    #elif defined(__SSE2__)
+    key << "-sse2";
+    #endif
+    return key.str();
+  }
+
+  /// @brief  The file where the parameters are stored:
+  ///         $NDAUTOCRR_ENGINE_CACHE, or else "ndautocrr_engines.txt" in
+  ///         $XDG_CACHE_HOME (or ~/.cache).  ("" if none of these exist.)
+  static string CacheFilename() {
+    const char *path = getenv("NDAUTOCRR_ENGINE_CACHE");
+    if (path && (*path != '\0'))
+      return path;
+    string dir;
+    const char *cache_home = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    if (cache_home && (*cache_home != '\0'))
+      dir = cache_home;
+    else if (home && (*home != '\0'))
+      dir = string(home) + "/.cache";
+    else
+      return "";
+    mkdir(dir.c_str(), 0755);  // (in case it does not exist yet)
+    return dir + "/ndautocrr_engines.txt";
+  }
+
+  /// @brief  Read the parameters named "key" from a file created by Save().
+  ///         Returns false if the file (or that entry) does not exist.
+  bool Load(const string &filename, const string &key) {
+    ifstream in(filename.c_str());
+    string line;
+    while (getline(in, line)) {
+      stringstream ss(line);
+      string name;
+      EngineCostModel m;
+      if ((ss >> name) && (name == key) &&
+          (ss >> m.direct_product >> m.direct_product_rms
+              >> m.fft_point_small >> m.fft_point_large) &&
+          (m.direct_product > 0.0) && (m.direct_product_rms > 0.0) &&
+          (m.fft_point_small > 0.0) && (m.fft_point_large > 0.0)) {
+        direct_product = m.direct_product;
+        direct_product_rms = m.direct_product_rms;
+        fft_point_small = m.fft_point_small;
+        fft_point_large = m.fft_point_large;
+        source = filename;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /// @brief  Store the parameters (named "key") in a file.
+  ///         (The entries with other names are preserved.)
+  ///         The new file is written under a temporary name and then renamed,
+  ///         so other processes reading the file never see it half-written.
+  ///         Returns false if the file could not be written.
+  bool Save(const string &filename, const string &key) const {
+    vector<string> vLines;
+    {
+      ifstream in(filename.c_str());
+      string line;
+      while (getline(in, line)) {
+        stringstream ss(line);
+        string name;
+        if ((ss >> name) && (name != key) && (name[0] != '#'))
+          vLines.push_back(line);
+      }
+    }
+    stringstream tmp_name;
+    tmp_name << filename << ".tmp" << getpid();
+    string tmp_filename = tmp_name.str();
+    ofstream out(tmp_filename.c_str());
+    if (! out)
+      return false;
+    out << "# ndautocrr engine cost model (delete this file to measure it again)\n"
+        << "# name  direct_s_per_product  direct_rms_s_per_product  "
+        << "fft_s_per_MlogM(M=2^" << log2_M_small << ")  "
+        << "fft_s_per_MlogM(M=2^" << log2_M_large << ")\n";
+    for (size_t k=0; k < vLines.size(); k++)
+      out << vLines[k] << "\n";
+    out.precision(6);
+    out << key << " " << direct_product << " " << direct_product_rms
+        << " " << fft_point_small << " " << fft_point_large << "\n";
+    out.close();
+    if ((! out) || (rename(tmp_filename.c_str(), filename.c_str()) != 0)) {
+      remove(tmp_filename.c_str());
+      return false;
+    }
+    return true;
+  }
+
+}; //class EngineCostModel
+
+
+
+#endif //#ifndef _ENGINE_MODEL_HPP
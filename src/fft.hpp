@@ -0,0 +1,255 @@
+///   @file fft.hpp
+///   @brief  A small self-contained radix-2 fast Fourier transform, and a
+///           function which uses it to compute autocorrelations
+///           (via the Wiener-Khinchin theorem).
+///           This avoids the need to link against an external FFT library.
+
+#ifndef _FFT_HPP
+#define _FFT_HPP
+
+#include <vector>
+#include <utility>
+#include <complex>
+#include <cassert>
+#define _USE_MATH_DEFINES
+#include <cmath>
+using namespace std;
+
+
+
+/// @brief  Return the smallest power of 2 which is >= n.
+inline size_t
+NextPow2(size_t n)
+{
+  size_t m = 1;
+  while (m < n)
+    m <<= 1;
+  return m;
+}
+
+
+
+/// @brief  An in-place iterative radix-2 (Cooley-Tukey) FFT of a fixed size.
+///         The "twiddle factors" are computed once (in the constructor),
+///         so that the same object can be used to transform many arrays.
+
+class RadixTwoFFT {
+
+  size_t n;                     //the size of the arrays (a power of 2)
+  vector<complex<double> > aW;  //aW[k] = exp(-2*pi*i*k/n)   (0 <= k < n/2)
+
+public:
+
+  RadixTwoFFT(size_t _n = 1):n(_n) {
+    assert(n == NextPow2(n));
+    aW.resize(n/2);
+    for (size_t k=0; k < n/2; k++) {
+      double theta = (-2.0 * M_PI * k) / n;
+      aW[k] = complex<double>(cos(theta), sin(theta));
+    }
+  }
+
+  size_t size() const { return n; }
+
+  /// @brief  Replace the contents of aZ with its discrete Fourier transform:
+  ///   Z[k] = Σ_m z[m] exp(-2πi*k*m/n)    (or exp(+2πi*k*m/n) if inverse)
+  /// (Note: The inverse transform is not divided by n.)
+  void
+  Transform(vector<complex<double> > &aZ, bool inverse = false) const
+  {
+    assert(aZ.size() == n);
+
+    // bit-reversal permutation
+    for (size_t i=1, j=0; i < n; i++) {
+      size_t bit = n >> 1;
+      for (; j & bit; bit >>= 1)
+        j ^= bit;
+      j ^= bit;
+      if (i < j)
+        swap(aZ[i], aZ[j]);
+    }
+
+    // butterflies
+    for (size_t len=2; len <= n; len <<= 1) {
+      size_t half = len >> 1;
+      size_t stride = n / len; //step through aW[] with this stride
+      for (size_t i=0; i < n; i += len) {
+        for (size_t k=0; k < half; k++) {
+          complex<double> w = aW[k*stride];
+          if (inverse)
+            w = conj(w);
+          complex<double> u = aZ[i+k];
+          complex<double> v = aZ[i+k+half] * w;
+          aZ[i+k]      = u + v;
+          aZ[i+k+half] = u - v;
+        }
+      }
+    }
+  } //Transform()
+
+}; //class RadixTwoFFT
+
+
+
+/// @brief  Compute the (non-periodic) autocorrelation of one or more real
+///         series, summed over all of the series:
+///
+///    aA[j] = Σ_s Σ_{i=0}^{N-1-j} x_s(i) * x_s(i+j)     (0 <= j < N)
+///
+///         The series are zero-padded to a power of 2 which is >= 2N,
+///         so that the circular convolution computed by the FFT does not
+///         wrap around.  Two real series are packed into the real and
+///         imaginary parts of each complex transform.  If Z = FFT(a + i*b),
+///         then the sum of the power spectra of a and b is
+///         |A[k]|^2 + |B[k]|^2 = (|Z[k]|^2 + |Z[n-k]|^2) / 2.
+///
+///         The "x" argument is a function object: x(s, i) returns x_s(i).
+
+template<typename SeriesFunc>
+void
+AutoCorrelateFFT(size_t N,          //!< the length of each series
+                 size_t num_series, //!< the number of series to sum over
+                 SeriesFunc x,      //!< x(s, i) returns x_s(i)
+                 vector<double> &aA) //!< store the result here (size N)
+{
+  aA.assign(N, 0.0);
+  if ((N == 0) || (num_series == 0))
+    return;
+
+  size_t M = NextPow2(2*N);
+  RadixTwoFFT fft(M);
+  vector<complex<double> > aZ(M);
+  vector<double> aPowerSpectrum(M, 0.0);
+
+  for (size_t s=0; s < num_series; s += 2) {
+    bool pair = (s+1 < num_series);
+    for (size_t i=0; i < N; i++)
+      aZ[i] = complex<double>(x(s, i), (pair ? x(s+1, i) : 0.0));
+    for (size_t i=N; i < M; i++)
+      aZ[i] = 0.0;
+
+    fft.Transform(aZ);
+
+    if (pair) {
+      for (size_t k=0; k < M; k++) {
+        size_t k_neg = (M-k) & (M-1);  // (M-k) % M
+        aPowerSpectrum[k] += 0.5 * (norm(aZ[k]) + norm(aZ[k_neg]));
+      }
+    }
+    else {
+      for (size_t k=0; k < M; k++)
+        aPowerSpectrum[k] += norm(aZ[k]);
+    }
+  }
+
+  // The autocorrelation is the inverse transform of the power spectrum.
+  for (size_t k=0; k < M; k++)
+    aZ[k] = aPowerSpectrum[k];
+  fft.Transform(aZ, true);
+
+  for (size_t j=0; j < N; j++)
+    aA[j] = aZ[j].real() / M;
+
+} //AutoCorrelateFFT()
+
+
+
+/// @brief  Compute the cross-correlations between several pairs of real
+///         series (a, b), for separations 0 <= j <= max_lag:
+///
+///    vvR[p][j] = Σ_i x_a(i) * x_b(i+j)       where (a,b) = vPairs[p]
+///
+///         In the non-periodic case, the sum is over 0 <= i < N-j.
+///         In the periodic case, the sum is over 0 <= i < N, and i+j is
+///         replaced by (i+j)%N.  (This requires max_lag < N.)
+///
+///         Each series is transformed only once (two real series are packed
+///         into each complex transform), and its transform is reused for
+///         every pair which contains it.  The (real) cross-correlations of
+///         two different pairs are also computed using a single inverse
+///         transform, because IFFT(S1 + i*S2) = s1 + i*s2.
+///         Only half of each spectrum (0 <= k <= M/2) is stored, because
+///         the spectra of real series satisfy X[M-k] = conj(X[k]).
+///
+///         The "x" argument is a function object: x(s, i) returns x_s(i).
+
+template<typename SeriesFunc>
+void
+CrossCorrelateFFT(size_t N,          //!< the length of each series
+                  size_t num_series, //!< the number of series
+                  SeriesFunc x,      //!< x(s, i) returns x_s(i)
+                  const vector<pair<size_t, size_t> > &vPairs, //!< (a,b) pairs
+                  size_t max_lag,    //!< compute vvR[p][j] for j <= max_lag
+                  bool periodic,     //!< periodic boundary conditions?
+                  vector<vector<double> > &vvR) //!< store the result here
+{
+  size_t P = vPairs.size();
+  vvR.assign(P, vector<double>(max_lag+1, 0.0));
+  if ((N == 0) || (num_series == 0) || (P == 0))
+    return;
+  assert((! periodic) || (max_lag < N));
+
+  size_t M = NextPow2(2*N);
+  size_t H = M/2 + 1;   // the number of spectral entries stored per series
+  RadixTwoFFT fft(M);
+  vector<complex<double> > aZ(M);
+
+  // Forward transforms (of the zero-padded series)
+  vector<vector<complex<double> > > vX(num_series);
+  for (size_t s=0; s < num_series; s += 2) {
+    bool pair = (s+1 < num_series);
+    for (size_t i=0; i < N; i++)
+      aZ[i] = complex<double>(x(s, i), (pair ? x(s+1, i) : 0.0));
+    for (size_t i=N; i < M; i++)
+      aZ[i] = 0.0;
+    fft.Transform(aZ);
+    // If Z = FFT(a + i*b), then A[k] = (Z[k] + conj(Z[M-k]))/2
+    //                       and  B[k] = (Z[k] - conj(Z[M-k]))/(2i)
+    vX[s].resize(H);
+    if (pair)
+      vX[s+1].resize(H);
+    for (size_t k=0; k < H; k++) {
+      complex<double> z = aZ[k];
+      complex<double> z_neg = conj(aZ[(M-k) & (M-1)]);
+      vX[s][k] = 0.5 * (z + z_neg);
+      if (pair)
+        vX[s+1][k] = complex<double>(0.0, -0.5) * (z - z_neg);
+    }
+  }
+
+  // Inverse transforms of the cross spectra, conj(X_a[k]) * X_b[k]
+  // (two pairs at a time)
+  for (size_t p=0; p < P; p += 2) {
+    bool two = (p+1 < P);
+    const vector<complex<double> > &Xa = vX[vPairs[p].first];
+    const vector<complex<double> > &Xb = vX[vPairs[p].second];
+    for (size_t k=0; k < H; k++) {
+      complex<double> S1 = conj(Xa[k]) * Xb[k];
+      complex<double> S2 = 0.0;
+      if (two)
+        S2 = conj(vX[vPairs[p+1].first][k]) * vX[vPairs[p+1].second][k];
+      const complex<double> I(0.0, 1.0);
+      aZ[k] = S1 + I*S2;
+      if ((k > 0) && (k < M-k))
+        aZ[M-k] = conj(S1) + I*conj(S2);
+    }
+    fft.Transform(aZ, true);
+
+    // aZ[m] now stores M * r(m), where r(m) = Σ_i x_a(i)*x_b(i+m),
+    // where negative m values are stored at M+m.
+    for (size_t j=0; j <= max_lag; j++) {
+      complex<double> r = 0.0;
+      if (j < N)
+        r = aZ[j];
+      if (periodic && (j > 0))
+        r += aZ[M - (N-j)];   //  Σ_{i >= N-j} x_a(i)*x_b(i+j-N)
+      vvR[p][j] = r.real() / M;
+      if (two)
+        vvR[p+1][j] = r.imag() / M;
+    }
+  }
+} //CrossCorrelateFFT()
+
+
+
+#endif //#ifndef _FFT_HPP
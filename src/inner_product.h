@@ -3,22 +3,470 @@
 
 #include <vector>
 #include <cmath>
+#include <unistd.h>
+#if defined(__SSE2__) || defined(__AVX__)
+#include <immintrin.h>
+#endif
 using namespace std;
 
 // This function is used to multiply entries together (eg. x(i) and x(i+j))
 // whcn computing the correlation function
 // C(j) = ⟨(**x**(i)-⟨**x**⟩)⋅(**x**(i+j)-⟨**x**⟩)⟩
 
-inline double 
-inner_product(const vector<double> &vXa_d,
-	      const vector<double> &vXb_d)
+template<typename Scalar>
+inline Scalar
+inner_product(const vector<Scalar> &vXa_d,
+              const vector<Scalar> &vXb_d)
 {
   long D = vXa_d.size();
-  double total = 0.0;
+  Scalar total = 0.0;
   for (long d=0; d < D; ++d)
     total += vXa_d[d] * vXb_d[d];
   return total;
 }
 
 
+/// @brief  The same function, operating on raw (contiguous) arrays of length D
+/// @overloaded
+
+template<typename Scalar>
+inline Scalar
+inner_product(const Scalar *aXa_d,
+              const Scalar *aXb_d,
+              size_t D)
+{
+  Scalar total = 0.0;
+  for (size_t d=0; d < D; ++d)
+    total += aXa_d[d] * aXb_d[d];
+  return total;
+}
+
+
+
+
+// ------------------------------------------------------------------------
+// Lag kernels
+//
+// The functions below compute the inner products x(i)⋅x(i+j) for many
+// consecutive i at once (for a fixed separation j), and add them up:
+//
+//   sum   += Σ_i  x(i)⋅x(i+j)
+//   sumsq += Σ_i (x(i)⋅x(i+j))^2      (only if RMS == true)
+//
+// The data is stored in column-major order: x_d(i) = aX[d*ld + i],
+// so that the loop over i (for each component d) is contiguous in memory
+// and can be vectorized (using SSE2 or AVX instructions when available).
+// The dimension, D, is a template parameter, so the loop over d is
+// unrolled by the compiler.  (D == 0 means "determine D at run time".)
+// ------------------------------------------------------------------------
+
+
+/// @brief  A minimal wrapper around the SIMD registers for a given Scalar
+///         type.  The generic version has width 1 (ie. no SIMD).
+
+template<typename Scalar>
+struct SimdPack {
+  typedef double type;
+  static const int width = 1;
+  static type zero() { return 0.0; }
+  static type load(const Scalar *p) { return static_cast<double>(*p); }
+  static type add(type a, type b) { return a + b; }
+  static type mul(type a, type b) { return a * b; }
+  static double hsum(type a) { return a; }
+};
+
+#if defined(__AVX__)
+
+template<>
+struct SimdPack<double> {
+  typedef __m256d type;
+  static const int width = 4;
+  static type zero() { return _mm256_setzero_pd(); }
+  static type load(const double *p) { return _mm256_loadu_pd(p); }
+  static type add(type a, type b) { return _mm256_add_pd(a, b); }
+  static type mul(type a, type b) { return _mm256_mul_pd(a, b); }
+  static double hsum(type a) {
+    __m128d lo = _mm256_castpd256_pd128(a);
+    __m128d hi = _mm256_extractf128_pd(a, 1);
+    lo = _mm_add_pd(lo, hi);
+    return _mm_cvtsd_f64(_mm_add_sd(lo, _mm_unpackhi_pd(lo, lo)));
+  }
+};
+
+#elif defined(__SSE2__)
+
+template<>
+struct SimdPack<double> {
+  typedef __m128d type;
+  static const int width = 2;
+  static type zero() { return _mm_setzero_pd(); }
+  static type load(const double *p) { return _mm_loadu_pd(p); }
+  static type add(type a, type b) { return _mm_add_pd(a, b); }
+  static type mul(type a, type b) { return _mm_mul_pd(a, b); }
+  static double hsum(type a) {
+    return _mm_cvtsd_f64(_mm_add_sd(a, _mm_unpackhi_pd(a, a)));
+  }
+};
+
+#endif //#if defined(__AVX__) ... #elif defined(__SSE2__)
+
+
+// Single-precision (float32) data is converted to double precision as it
+// is loaded, so the products and sums are always computed in double precision.
+// (Storing the data as float32 halves the memory and bandwidth required.)
+
+#if defined(__AVX__)
+
+template<>
+struct SimdPack<float> : public SimdPack<double> {
+  static type load(const float *p) { return _mm256_cvtps_pd(_mm_loadu_ps(p)); }
+};
+
+#elif defined(__SSE2__)
+
+template<>
+struct SimdPack<float> : public SimdPack<double> {
+  static type load(const float *p) {
+    __m128i two_floats = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p));
+    return _mm_cvtps_pd(_mm_castsi128_ps(two_floats));
+  }
+};
+
+#endif //#if defined(__AVX__) ... #elif defined(__SSE2__)
+
+
+
+/// @brief  Add x to a sum, keeping track of the round-off error in "comp"
+///         (Neumaier's variant of Kahan summation).  The accurate result
+///         is sum + comp.  (This is used when adding many partial sums
+///         together, not in the inner loops.)
+inline void
+CompensatedAdd(double &sum,   //!< the running sum
+               double &comp,  //!< the accumulated round-off error
+               double x)      //!< the number to add
+{
+  // ("volatile" prevents optimizations like -ffast-math from simplifying
+  //  the correction terms below to zero.)
+  volatile double t = sum + x;
+  double t_ = t;
+  if (fabs(sum) >= fabs(x))
+    comp += (sum - t_) + x;
+  else
+    comp += (x - t_) + sum;
+  sum = t_;
+}
+
+
+
+/// @brief  Add Σ_i x(i)⋅x(i+j) (and Σ_i (x(i)⋅x(i+j))^2) over the range
+///         i_begin <= i < i_end to "sum" (and "sumsq").
+///         Entries x_d(i) are located at aX[d*ld + i].
+
+template<int D_FIXED, bool RMS, typename Scalar>
+void
+LagSum(const Scalar *aX,  //!< the data (in column-major order)
+       size_t ld,         //!< the length of each column in aX
+       size_t D,          //!< the number of columns (ignored unless D_FIXED==0)
+       size_t i_begin,    //!< the first i value
+       size_t i_end,      //!< one past the last i value
+       size_t j,          //!< the separation
+       double &sum,       //!< add Σ_i x(i)⋅x(i+j) to this number
+       double &sumsq)     //!< add Σ_i (x(i)⋅x(i+j))^2 to this number
+{
+  typedef SimdPack<Scalar> P;
+  typedef typename P::type V;
+  const size_t W = P::width;
+  const size_t nd = (D_FIXED > 0) ? D_FIXED : D;
+
+  // two independent accumulators (to hide the latency of each addition)
+  V acc0 = P::zero(), acc1 = P::zero();
+  V accsq0 = P::zero(), accsq1 = P::zero();
+
+  size_t i = i_begin;
+  for (; i + 2*W <= i_end; i += 2*W) {
+    V c0 = P::zero(), c1 = P::zero();
+    for (size_t d=0; d < nd; d++) {
+      const Scalar *pa = aX + d*ld + i;
+      const Scalar *pb = pa + j;
+      c0 = P::add(c0, P::mul(P::load(pa),   P::load(pb)));
+      c1 = P::add(c1, P::mul(P::load(pa+W), P::load(pb+W)));
+    }
+    acc0 = P::add(acc0, c0);
+    acc1 = P::add(acc1, c1);
+    if (RMS) {
+      accsq0 = P::add(accsq0, P::mul(c0, c0));
+      accsq1 = P::add(accsq1, P::mul(c1, c1));
+    }
+  }
+
+  double total = P::hsum(P::add(acc0, acc1));
+  double totalsq = 0.0;
+  if (RMS)
+    totalsq = P::hsum(P::add(accsq0, accsq1));
+
+  // remaining entries
+  for (; i < i_end; i++) {
+    double c = 0.0;
+    for (size_t d=0; d < nd; d++)
+      c += (static_cast<double>(aX[d*ld + i]) *
+            static_cast<double>(aX[d*ld + i + j]));
+    total += c;
+    if (RMS)
+      totalsq += c*c;
+  }
+
+  sum += total;
+  if (RMS)
+    sumsq += totalsq;
+} //LagSum()
+
+
+
+/// @brief  A pointer to one of the LagSum() kernels
+template<typename Scalar>
+struct LagSumKernel {
+  typedef void (*type)(const Scalar *aX, size_t ld, size_t D,
+                       size_t i_begin, size_t i_end, size_t j,
+                       double &sum, double &sumsq);
+};
+
+
+/// @brief  Choose the appropriate LagSum() kernel for data of dimension D.
+///         (Do this once for each data set, rather than once for each pair.)
+
+template<typename Scalar>
+typename LagSumKernel<Scalar>::type
+ChooseLagSumKernel(size_t D, bool rms)
+{
+  switch (D) {
+  case 1:
+    return rms ? LagSum<1, true, Scalar> : LagSum<1, false, Scalar>;
+  case 2:
+    return rms ? LagSum<2, true, Scalar> : LagSum<2, false, Scalar>;
+  case 3:
+    return rms ? LagSum<3, true, Scalar> : LagSum<3, false, Scalar>;
+  case 4:
+    return rms ? LagSum<4, true, Scalar> : LagSum<4, false, Scalar>;
+  default:
+    return rms ? LagSum<0, true, Scalar> : LagSum<0, false, Scalar>;
+  }
+}
+
+
+// ------------------------------------------------------------------------
+// Cache blocking (tiling)
+//
+// When the data set does not fit in the cache, computing one lag at a time
+// reads the entire data set from memory once for every j.  Instead, the
+// lags are processed in blocks (j_begin <= j < j_end), and the i values are
+// divided into tiles (i0 <= i < i1).  For each tile, the sums for every j in
+// the block are computed while x(i0...i1) and x(i0+j_begin...i1+j_end) are
+// still in the cache.
+// ------------------------------------------------------------------------
+
+
+/// @brief  Return the size of the (per-core) cache in bytes, or a
+///         conservative guess if it can not be determined.
+inline size_t
+CacheSizeBytes()
+{
+  static size_t cache_size = 0;
+  if (cache_size == 0) {
+    long n = -1;
+    #ifdef _SC_LEVEL2_CACHE_SIZE
+    n = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    #endif
+    cache_size = (n > 0) ? n : (1 << 18);
+  }
+  return cache_size;
+}
+
+
+/// @brief  The dimensions of each tile.
+struct LagTile {
+  size_t i;  //!< the number of i values in each tile
+  size_t j;  //!< the number of j values (lags) in each block
+};
+
+
+/// @brief  Choose the tile dimensions for a data set with N entries,
+///         each containing D numbers (of the given size in bytes).
+///         A tile (and the part of the data set which it is multiplied
+///         with) should occupy at most half of the cache.
+
+inline LagTile
+ChooseLagTile(size_t N, size_t D, size_t bytes_per_number)
+{
+  size_t budget = CacheSizeBytes() / 2;
+  size_t bytes_per_entry = D * bytes_per_number;
+  if (bytes_per_entry == 0)
+    bytes_per_entry = bytes_per_number;
+  // A tile of width t (for both i and j) touches approximately 3*t entries:
+  // x(i0 ... i0+t) and x(i0+j_begin ... i0+j_begin+2*t)
+  size_t t = budget / (3 * bytes_per_entry);
+  t -= t % 16;
+  if (t < 16)
+    t = 16;
+  LagTile tile;
+  tile.j = t;
+  tile.i = t;
+  if (N * bytes_per_entry <= budget)
+    tile.i = N;   // the entire data set fits in the cache (no tiling needed)
+  return tile;
+}
+
+
+/// @brief  Compute the sums for all of the lags in a block
+///         (j_begin <= j < j_end) using the selected LagSum() kernel,
+///         processing tile_i values of i at a time:
+///
+///   aC[j-j_begin]   += Σ_i  x(i)⋅x(i+j)
+///   aCsq[j-j_begin] += Σ_i (x(i)⋅x(i+j))^2
+///
+///         where 0 <= i < N (if periodic) or 0 <= i < N-j (otherwise).
+///         (In the periodic case, the columns of aX must be extended so that
+///          x_d(i) = x_d(i-N) for N <= i < N+j_end-1.)
+///         Optionally, the sum can be restricted to i_first <= i < i_last.
+///         The partial sums from each tile are added together using
+///         compensated summation.
+
+template<typename Scalar>
+void
+LagBlockSum(typename LagSumKernel<Scalar>::type lag_sum, //!< the kernel
+            const Scalar *aX,  //!< the data (in column-major order)
+            size_t ld,         //!< the length of each column in aX
+            size_t D,          //!< the number of columns
+            size_t N,          //!< the number of entries
+            bool periodic,     //!< periodic boundary conditions?
+            size_t j_begin,    //!< the first lag in the block
+            size_t j_end,      //!< one past the last lag in the block
+            size_t tile_i,     //!< the number of i values in each tile
+            double *aC,        //!< add the sums here
+            double *aCsq,      //!< add the sums of squares here
+            size_t i_first = 0,               //!< the first i value
+            size_t i_last = static_cast<size_t>(-1)) //!< one past the last i
+{
+  if (j_begin >= j_end)
+    return;
+  size_t i_end = periodic ? N : N - j_begin; //the largest range of i values
+  if (i_end > i_last)
+    i_end = i_last;
+  if (i_first >= i_end)
+    return;
+  if (tile_i >= i_end - i_first) {
+    // (no tiling)
+    for (size_t j = j_begin; j < j_end; j++) {
+      size_t num_i = periodic ? N : N - j;
+      if (num_i > i_last)
+        num_i = i_last;
+      if (num_i > i_first)
+        lag_sum(aX, ld, D, i_first, num_i, j,
+                aC[j-j_begin], aCsq[j-j_begin]);
+    }
+    return;
+  }
+  vector<double> aComp(2*(j_end - j_begin), 0.0); // round-off errors
+  for (size_t i0 = i_first; i0 < i_end; i0 += tile_i) {
+    size_t i1 = i0 + tile_i;
+    if (i1 > i_end)
+      i1 = i_end;
+    for (size_t j = j_begin; j < j_end; j++) {
+      size_t num_i = periodic ? N : N - j;
+      if (num_i > i_last)
+        num_i = i_last;
+      if (num_i <= i0)
+        break;   // (num_i decreases with j)
+      double C = 0.0;
+      double Csq = 0.0;
+      lag_sum(aX, ld, D, i0, (num_i < i1 ? num_i : i1), j, C, Csq);
+      size_t k = j - j_begin;
+      CompensatedAdd(aC[k], aComp[2*k], C);
+      CompensatedAdd(aCsq[k], aComp[2*k+1], Csq);
+    }
+  }
+  for (size_t k = 0; k < j_end - j_begin; k++) {
+    aC[k] += aComp[2*k];
+    aCsq[k] += aComp[2*k+1];
+  }
+} //LagBlockSum()
+
+
+
+/// @brief  Add Σ_i x_a(i)*x_b(i+j) over the range i_begin <= i < i_end
+///         to "sum".  (This is used to compute cross-correlations between
+///         two different columns, a and b.)
+
+template<typename Scalar>
+void
+CrossLagSum(const Scalar *aXa, //!< column a (x_a(i) = aXa[i])
+            const Scalar *aXb, //!< column b (x_b(i) = aXb[i])
+            size_t i_begin,    //!< the first i value
+            size_t i_end,      //!< one past the last i value
+            size_t j,          //!< the separation
+            double &sum)       //!< add Σ_i x_a(i)*x_b(i+j) to this number
+{
+  typedef SimdPack<Scalar> P;
+  typedef typename P::type V;
+  const size_t W = P::width;
+
+  V acc0 = P::zero(), acc1 = P::zero();
+  size_t i = i_begin;
+  for (; i + 2*W <= i_end; i += 2*W) {
+    const Scalar *pa = aXa + i;
+    const Scalar *pb = aXb + i + j;
+    acc0 = P::add(acc0, P::mul(P::load(pa),   P::load(pb)));
+    acc1 = P::add(acc1, P::mul(P::load(pa+W), P::load(pb+W)));
+  }
+  double total = P::hsum(P::add(acc0, acc1));
+  for (; i < i_end; i++)
+    total += static_cast<double>(aXa[i]) * static_cast<double>(aXb[i+j]);
+  sum += total;
+} //CrossLagSum()
+
+
+/// @brief  The equivalent of LagBlockSum() for the cross-correlation
+///         between two columns:
+///
+///   aC[j-j_begin] += Σ_i  x_a(i)*x_b(i+j)      (j_begin <= j < j_end)
+
+template<typename Scalar>
+void
+CrossBlockSum(const Scalar *aXa, //!< column a
+              const Scalar *aXb, //!< column b (extended if periodic)
+              size_t N,          //!< the number of entries
+              bool periodic,     //!< periodic boundary conditions?
+              size_t j_begin,    //!< the first lag in the block
+              size_t j_end,      //!< one past the last lag in the block
+              size_t tile_i,     //!< the number of i values in each tile
+              double *aC)        //!< add the sums here
+{
+  if (j_begin >= j_end)
+    return;
+  size_t i_end = periodic ? N : N - j_begin; //the largest range of i values
+  if (tile_i >= i_end) {
+    // (no tiling)
+    for (size_t j = j_begin; j < j_end; j++)
+      CrossLagSum(aXa, aXb, 0, (periodic ? N : N - j), j, aC[j-j_begin]);
+    return;
+  }
+  vector<double> aComp(j_end - j_begin, 0.0); // round-off errors
+  for (size_t i0 = 0; i0 < i_end; i0 += tile_i) {
+    size_t i1 = i0 + tile_i;
+    if (i1 > i_end)
+      i1 = i_end;
+    for (size_t j = j_begin; j < j_end; j++) {
+      size_t num_i = periodic ? N : N - j;
+      if (num_i <= i0)
+        break;   // (num_i decreases with j)
+      double C = 0.0;
+      CrossLagSum(aXa, aXb, i0, (num_i < i1 ? num_i : i1), j, C);
+      CompensatedAdd(aC[j-j_begin], aComp[j-j_begin], C);
+    }
+  }
+  for (size_t k = 0; k < j_end - j_begin; k++)
+    aC[k] += aComp[k];
+} //CrossBlockSum()
+
+
+
 #endif //#ifndef CUSTOM_INNER_PRODUCT_H
@@ -11,8 +11,15 @@
 #include <sstream>
 #include <cstdlib>
 #include <cstring>
+#include <vector>
+#include <chrono>
+#include <cassert>
+#if __cplusplus >= 201703L
+#include <charconv>
+#endif
 using namespace std;
 #include "err.hpp"
+#include "dataset.hpp"
 
 
 
@@ -278,4 +285,384 @@ ReadInt(istream &in,
 
 
 
+/// @brief  Convert the text in the range [begin, end) into a number.
+///         Returns false unless the entire range is a valid number.
+///         (The character at *end must not be part of a number.
+///          It is typically whitespace, '#', or '\0'.)
+
+template<class Scalar>
+inline bool
+ParseScalar(const char *begin,
+            const char *end,
+            Scalar &dest)
+{
+  if (begin == end)
+    return false;
+
+  #if defined(__cpp_lib_to_chars)
+  // std::from_chars() is much faster than strtod(), but it does not
+  // accept a leading '+', so skip over it (if present).
+  const char *pstart = begin;
+  if ((*pstart == '+') && (pstart+1 < end) && (pstart[1] != '-'))
+    pstart++;
+  double x;
+  from_chars_result result = from_chars(pstart, end, x);
+  if ((result.ec == errc()) && (result.ptr == end)) {
+    dest = x;
+    return true;
+  }
+  // Otherwise (if the number was too large or small, or written in a format
+  // which from_chars() does not accept, such as "0x10"), let strtod() decide.
+  #endif
+
+  char *pstop;
+  #ifdef STRTOLD_UNSUPPORTED
+  dest = strtod(begin, &pstop);
+  #else
+  dest = strtold(begin, &pstop);//Useful but not standard ANSI C
+  #endif
+  return (pstop == end); //did parsing terminate prematurely?
+} //ParseScalar()
+
+
+
+/// @brief  BufferedReader reads data sets from a text file containing numbers
+///         arranged in columns (one data entry per line).  Data sets are
+///         separated by one or more lines which do not contain numbers
+///         (ie. blank lines, or lines containing only comments).
+///         Text following the g_comments_begin_with character ('#') on each
+///         line is ignored.
+///
+///         Rather than reading the file one character at a time, the file
+///         is read in large blocks, and the numbers are parsed directly
+///         from that buffer (without making temporary copies of each word).
+///
+///         Optionally, only some of the columns (SelectColumns()), and
+///         only every stride'th line of each data set (SetStride()) are read.
+///         The remaining words (and lines) are skipped without parsing them.
+
+class BufferedReader {
+
+  istream &in;
+  vector<char> aBuf;  // the buffer storing (a block of) the file
+  size_t pos;         // the location of the next unread character in aBuf
+  size_t end;         // the number of valid characters stored in aBuf
+  bool eof;           // have we reached the end of the file?
+
+  const string *pFilename; // the name of the file (for error messages)
+  long long *pLine;        // the current line number (for error messages)
+
+  // which columns (and lines) should be read?
+  vector<int> aColumnSlot; // store column k in aX_d[aColumnSlot[k]] (-1=skip)
+  size_t num_selected;     // the number of columns selected (0 = all)
+  size_t stride;           // only read every stride'th line of each data set
+
+  // statistics
+  size_t num_bytes;
+  size_t num_values;
+  size_t num_lines;
+  double parse_time;  // time spent reading (in seconds)
+
+public:
+
+  BufferedReader(istream &_in,
+                 size_t block_size = (1 << 20),
+                 const string *_pFilename = &g_filename,
+                 long long *_pLine = &g_line):
+    in(_in),
+    aBuf(block_size + 1),
+    pos(0),
+    end(0),
+    eof(false),
+    pFilename(_pFilename),
+    pLine(_pLine),
+    num_selected(0),
+    stride(1),
+    num_bytes(0),
+    num_values(0),
+    num_lines(0),
+    parse_time(0.0)
+  {
+    aBuf[0] = '\0';
+  }
+
+
+  /// @brief  Only read these columns (numbered from 0), in this order.
+  ///         (The other columns are skipped without converting them into
+  ///          numbers, but they are counted:  Each line must contain the
+  ///          same number of columns, including all of the selected columns.)
+  void
+  SelectColumns(const vector<size_t> &vColumns)
+  {
+    aColumnSlot.clear();
+    num_selected = vColumns.size();
+    for (size_t c=0; c < vColumns.size(); c++) {
+      if (vColumns[c] >= aColumnSlot.size())
+        aColumnSlot.resize(vColumns[c]+1, -1);
+      assert(aColumnSlot[vColumns[c]] < 0); // (each column is selected once)
+      aColumnSlot[vColumns[c]] = c;
+    }
+  }
+
+
+  /// @brief  Only read every stride'th line (entry) in each data set,
+  ///         beginning with the first line.  (The other lines are skipped
+  ///         without parsing them.)
+  void SetStride(size_t _stride) { assert(_stride > 0); stride = _stride; }
+
+
+  /// @brief  Read the next data set (and store it in X).
+  ///         Returns false if there are no more data sets in the file.
+  template<class Scalar>
+  bool
+  ReadDataSet(DataSet<Scalar> &X)
+  {
+    X.clear();
+    StreamDataSet<Scalar>([&X](const Scalar *aX_d, size_t D) {
+                            X.push_back(aX_d, D);
+                          },
+                          false);
+    return ! X.empty();
+  }
+
+
+  /// @brief  Read the next data set, one line at a time, without storing it.
+  ///         The numbers on each line are passed to the function object
+  ///         "process_entry(const Scalar *aX_d, size_t D)" as soon as that
+  ///         line has been read.  Returns the number of lines (entries)
+  ///         in the data set (or 0 if there are no more data sets).
+  template<class Scalar, class EntryFunc>
+  size_t
+  StreamDataSet(EntryFunc process_entry, //!< invoked once for each line
+                bool exclude_entry_time = true) //!< exclude the time spent in process_entry() from the parsing time?
+  {
+    chrono::steady_clock::time_point t_start = chrono::steady_clock::now();
+    size_t N = 0;         // the number of entries in this data set so far
+    size_t i = 0;         // the number of lines in it (including skipped lines)
+    size_t D = 0;         // the number of entries on each line
+    size_t W = 0;         // the number of words on each line (if num_selected>0)
+    vector<Scalar> vX_d;  // the numbers on the current line
+    const char *line_begin;
+    const char *line_end;
+    while (GetLine(line_begin, line_end)) {
+      if (i % stride != 0) {
+        // Skip this line.  (Only check whether it marks the end of the data set.)
+        if (IsBlank(line_begin, line_end))
+          break;
+        i++;
+        continue;
+      }
+      vX_d.clear();
+      size_t num_words = 0;
+      if (num_selected > 0)
+        num_words = ParseColumns(line_begin, line_end, vX_d);
+      else
+        ParseLine(line_begin, line_end, vX_d);
+      if (vX_d.size() == 0) {
+        if (N == 0)
+          continue;   // ignore blank lines preceeding the data set
+        else
+          break;      // a blank line marks the end of the data set
+      }
+      i++;
+      if (N == 0) {
+        D = vX_d.size();
+        W = num_words;
+      }
+      else if ((vX_d.size() != D) || (num_words != W)) {
+        stringstream err_msg;
+        err_msg << "Error in input: \"" << *pFilename << "\"\n"
+          "      near line " << *pLine << ": Inconsistent number of entries on each line.\n";
+        throw InputErr(err_msg.str().c_str());
+      }
+      num_values += D;
+      N++;
+      if (exclude_entry_time) {
+        chrono::steady_clock::time_point t = chrono::steady_clock::now();
+        parse_time += chrono::duration<double>(t - t_start).count();
+        process_entry(vX_d.data(), D);
+        t_start = chrono::steady_clock::now();
+      }
+      else
+        process_entry(vX_d.data(), D);
+    }
+    parse_time += chrono::duration<double>(chrono::steady_clock::now()
+                                           - t_start).count();
+    return N;
+  } //StreamDataSet()
+
+
+  /// @brief  Print the amount of data read, and how fast it was read.
+  void
+  ReportThroughput(ostream &out) const
+  {
+    double megabytes = num_bytes / 1.0e6;
+    out << "# parsed " << megabytes << " MB ("
+        << num_values << " numbers, " << num_lines << " lines) in "
+        << parse_time << " s";
+    if (parse_time > 0.0)
+      out << " (" << megabytes / parse_time << " MB/s, "
+          << num_values / parse_time << " numbers/s)";
+    out << "\n";
+  }
+
+  size_t NumBytes() const { return num_bytes; }
+  /// @brief  The number of bytes read so far, excluding the bytes which
+  ///         are still waiting in the buffer (to be parsed later)
+  size_t NumBytesParsed() const { return num_bytes - (end - pos); }
+  size_t NumValues() const { return num_values; }
+  double ParseTime() const { return parse_time; }
+
+private:
+
+  /// @brief  Find the next line in the file (excluding the newline character).
+  ///         Returns false at the end of the file.
+  bool
+  GetLine(const char *&line_begin, const char *&line_end)
+  {
+    if (num_lines > 0)
+      ++(*pLine);   // keep track of what line we are on
+
+    const char *pnewline = nullptr;
+    size_t search_from = pos;
+    while (true) {
+      pnewline = static_cast<const char*>(memchr(&aBuf[search_from], '\n',
+                                                  end - search_from));
+      if (pnewline || eof)
+        break;
+      // The buffer does not contain the entire line.  Read some more.
+      search_from = end - pos;
+      Refill();
+    }
+    if ((pos == end) && eof)
+      return false;
+
+    line_begin = &aBuf[pos];
+    if (pnewline) {
+      line_end = pnewline;
+      pos = (pnewline - &aBuf[0]) + 1;
+    }
+    else {
+      line_end = &aBuf[end];  // the last line lacks a newline character
+      pos = end;
+    }
+    num_lines++;
+    return true;
+  } //GetLine()
+
+
+  /// @brief  Discard the characters which were already read, and then
+  ///         append the next block of the file to the buffer.
+  ///         (If the buffer is full, make it larger.)
+  void
+  Refill()
+  {
+    size_t num_unread = end - pos;
+    if (pos > 0)
+      memmove(&aBuf[0], &aBuf[pos], num_unread);
+    pos = 0;
+    end = num_unread;
+    if (end + 1 >= aBuf.size())
+      aBuf.resize(2 * aBuf.size());  // (a line longer than the buffer)
+    in.read(&aBuf[end], aBuf.size() - 1 - end);
+    size_t num_read = in.gcount();
+    if (num_read == 0)
+      eof = true;
+    end += num_read;
+    num_bytes += num_read;
+    aBuf[end] = '\0'; // (ensure the number parser stops at the end)
+  }
+
+
+  /// @brief  Read all of the numbers on a line (ignoring comments).
+  template<class Scalar>
+  void
+  ParseLine(const char *p, const char *line_end, vector<Scalar> &vX_d)
+  {
+    while (p < line_end) {
+      if ((*p == ' ') || (*p == '\t')) {
+        ++p;
+        continue;
+      }
+      if (*p == g_comments_begin_with)
+        break;  // ignore the remainder of this line
+      const char *word_begin = p;
+      while ((p < line_end) && (*p != ' ') && (*p != '\t') &&
+             (*p != g_comments_begin_with))
+        ++p;
+      Scalar x;
+      if (! ParseScalar(word_begin, p, x))
+        ReportBadNumber(word_begin, p);
+      vX_d.push_back(x);
+    }
+  } //ParseLine()
+
+
+  /// @brief  Read the numbers in the selected columns (see SelectColumns()).
+  ///         The words in the other columns are skipped (they are counted,
+  ///         but not converted into numbers).  Returns the number of words.
+  ///         (vX_d is left empty if the line does not contain any numbers.)
+  template<class Scalar>
+  size_t
+  ParseColumns(const char *p, const char *line_end, vector<Scalar> &vX_d)
+  {
+    size_t num_columns = aColumnSlot.size(); // (the last column needed + 1)
+    size_t k = 0;   // the current column
+    vX_d.resize(num_selected);
+    while (p < line_end) {
+      if ((*p == ' ') || (*p == '\t')) {
+        ++p;
+        continue;
+      }
+      if (*p == g_comments_begin_with)
+        break;  // ignore the remainder of this line
+      const char *word_begin = p;
+      while ((p < line_end) && (*p != ' ') && (*p != '\t') &&
+             (*p != g_comments_begin_with))
+        ++p;
+      int slot = (k < num_columns) ? aColumnSlot[k] : -1;
+      if ((slot >= 0) && (! ParseScalar(word_begin, p, vX_d[slot])))
+        ReportBadNumber(word_begin, p);
+      k++;
+    }
+    if (k == 0)
+      vX_d.clear();  // (a blank line)
+    else if (k < num_columns) {
+      stringstream err_msg;
+      err_msg << "Error in input: \"" << *pFilename << "\"\n"
+        "      near line " << *pLine << ": Expected at least " << num_columns
+              << " columns (found " << k << ").\n";
+      throw InputErr(err_msg.str().c_str());
+    }
+    return k;
+  } //ParseColumns()
+
+
+  /// @brief  Does this line lack numbers?  (Is it blank, or just a comment?)
+  static bool
+  IsBlank(const char *p, const char *line_end)
+  {
+    while ((p < line_end) && ((*p == ' ') || (*p == '\t')))
+      ++p;
+    return (p == line_end) || (*p == g_comments_begin_with);
+  }
+
+
+  /// @brief  Complain about a word which is not a number
+  void
+  ReportBadNumber(const char *word_begin, const char *word_end) const
+  {
+    stringstream err_msg;
+    err_msg <<
+      "Error in input: \"" << *pFilename << "\"\n"
+      "      near line " << *pLine << ": \""
+            << string(word_begin, word_end) << "\"\n"
+      "      Expected a number." << endl;
+    throw InputErr(err_msg.str().c_str());
+  }
+
+}; //class BufferedReader
+
+
+
 #endif //#ifndef _IO_HPP
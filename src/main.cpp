@@ -4,11 +4,24 @@
 
 #include <vector>
 #include <cassert>
+#include <algorithm>
 #define _USE_MATH_DEFINES
 #include <cmath>
+#include <glob.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifndef DISABLE_OPENMP
+#include <omp.h>
+#endif
 using namespace std;
 #include "io.hpp"
+#include "binary_io.hpp"
 #include "ndautocrr.hpp"
+#include "multitau.hpp"
+#include "profile.hpp"
+#include "progress.hpp"
+#include "output.hpp"
+#include "engine_model.hpp"
 #include "err.hpp"
 
 
@@ -24,6 +37,768 @@ const char *g_spaces_and_newlines = " \t\n";
 
 
 
+/// @brief  The settings chosen by the user (from the argument list)
+struct Settings {
+  bool is_periodic;
+  size_t L;
+  double threshold;
+  bool subtract_ave;
+  bool report_rms;
+  bool report_nsum;
+  bool streaming;
+  string engine;          // "auto", "direct", or "fft"
+  EngineCostModel engine_model; // predicts which engine is faster ("auto")
+  string in_filename;     // read from this file (instead of stdin)?
+  string index_filename;  // file storing the offsets of each data set
+  size_t binary_bytes;    // 4 or 8 for raw float32/float64 files
+  size_t binary_D;        // the number of columns (for raw files)
+  bool npy_format;        // is the input file a NumPy ".npy" file?
+  bool cross;             // report cross-correlations between columns?
+  bool per_column;        // report the autocorrelation of each column?
+  vector<pair<size_t, size_t> > vPairs; // which pairs of columns? (empty=all)
+  size_t error_blocks;    // estimate errors using this many blocks per data set (0=no)
+  bool jackknife;         // estimate errors using the jackknife?
+  bool multitau;          // use the multi-tau (logarithmic-lag) correlator?
+  size_t multitau_p;      // the number of bins per level (multi-tau only)
+  string save_filename;   // save the (un-normalized) sums to this file?
+  vector<string> vLoadFilenames; // add the sums saved in these files
+  bool merge_only;        // do not read any data (only the saved sums)?
+  bool profile;           // report the time spent in each phase?
+  string profile_json_filename; // also write the profile to this file (JSON)?
+  double progress_interval; // report the progress this often (seconds, 0=no)
+  string out_npy_filename; // write the results to this ".npy" file instead?
+  size_t out_stride;      // print every out_stride'th lag
+  double out_per_decade;  // print lags spaced logarithmically? (0=no)
+  vector<string> vBatchFilenames; // process each of these files separately?
+  vector<size_t> vColumns; // only read these columns (empty = all columns)
+  size_t frame_stride;    // only read every frame_stride'th entry
+};
+
+
+
+/// @brief  A summary of the results (used by "-batch")
+struct RunSummary {
+  long num_data_sets;
+  double correlation_length;
+  double correlation_length_error; // (NaN unless "-err" or "-jackknife" was used)
+  RunSummary():num_data_sets(0), correlation_length(0.0),
+               correlation_length_error(NAN) {}
+};
+
+
+
+/// @brief  Print the time spent in each phase (if requested)
+void
+ReportProfile(const Profiler &profiler, const Settings &settings,
+              ostream &log)
+{
+  if (! settings.profile)
+    return;
+  profiler.Report(log);
+  if (! settings.profile_json_filename.empty()) {
+    ofstream json_file(settings.profile_json_filename.c_str());
+    if (! json_file)
+      throw InputErr("Error: Unable to create file \""
+                     + settings.profile_json_filename + "\"\n");
+    profiler.WriteJSON(json_file);
+  }
+}
+
+
+
+/// @brief  Does "-engine auto" have a choice to make?  ("-stream",
+///         "-multitau", and "-err B" with B>1 always use the direct engine.)
+bool
+ChoosesEngine(const Settings &settings)
+{
+  return ((settings.engine == "auto") && (! settings.streaming) &&
+          (! settings.multitau) && (! settings.merge_only) &&
+          (settings.error_blocks <= 1));
+}
+
+
+
+/// @brief  If the engine is chosen automatically ("-engine auto"), then read
+///         the cost model it uses from the cache file (if it is there).
+///         Otherwise it is measured later, but only if the amount of
+///         computation is large enough for the choice to matter.
+///         (See NdAutocrr::SetCostModel() and NdAutocrr::LoadCostModel().)
+template<typename Scalar>
+void
+LoadEngineModel(Settings &settings, ostream &log)
+{
+  if ((! ChoosesEngine(settings)) ||
+      (! settings.engine_model.source.empty()))  // (already loaded?)
+    return;
+  if (NdAutocrr<Scalar>::ReadCostModel(settings.engine_model))
+    log << "# engine: using the cost model in \""
+        << settings.engine_model.source << "\"\n";
+}
+
+
+
+/// @brief  Print the number of data sets processed by each engine
+template<typename Scalar>
+void
+ReportEngines(const NdAutocrr<Scalar> &ndautocrr, ostream &log)
+{
+  size_t num_direct = ndautocrr.NumDataSets(NdAutocrr<Scalar>::ENGINE_DIRECT);
+  size_t num_fft = ndautocrr.NumDataSets(NdAutocrr<Scalar>::ENGINE_FFT);
+  log << "# engine: direct for " << num_direct << " data set"
+      << (num_direct == 1 ? "" : "s") << ", fft for " << num_fft
+      << " data set" << (num_fft == 1 ? "" : "s") << "\n";
+}
+
+
+
+/// @brief  Read the data, calculate the correlation function, and print it.
+///         The data is stored in memory using the "Scalar" type (float or
+///         double).  (The sums are always computed in double precision.)
+///         The correlation function is printed to "out", and the other
+///         messages are printed to "log".
+template<typename Scalar>
+RunSummary
+Run(Settings settings,
+    ostream &out = cout, //!< print the correlation function here
+    ostream &log = cerr) //!< print everything else here
+{
+  bool is_periodic = settings.is_periodic;
+  size_t L = settings.L;
+  double threshold = settings.threshold;
+  bool subtract_ave = settings.subtract_ave;
+  bool report_rms = settings.report_rms;
+  bool report_nsum = settings.report_nsum;
+  bool streaming = settings.streaming;
+  const string &in_filename = settings.in_filename;
+  const string &index_filename = settings.index_filename;
+  size_t binary_bytes = settings.binary_bytes;
+  size_t binary_D = settings.binary_D;
+  bool npy_format = settings.npy_format;
+
+  // allocate the array to store the auto-correlation function
+
+  typename NdAutocrr<Scalar>::Engine engine = NdAutocrr<Scalar>::ENGINE_DIRECT;
+  if (settings.engine == "fft")
+    engine = NdAutocrr<Scalar>::ENGINE_FFT;
+  else if (settings.engine == "auto")
+    engine = NdAutocrr<Scalar>::ENGINE_AUTO;
+
+  NdAutocrr<Scalar>
+    ndautocrr = NdAutocrr<Scalar>(threshold,
+                                  L,
+                                  is_periodic,
+                                  subtract_ave,
+                                  report_rms,
+                                  engine);
+  LoadEngineModel<Scalar>(settings, log);
+  if (ChoosesEngine(settings))
+    ndautocrr.SetCostModel(settings.engine_model, &log);
+  if (settings.cross)
+    ndautocrr.SetCrossPairs(settings.vPairs);
+  else if (settings.per_column)
+    ndautocrr.SetPerColumn();
+  if (settings.error_blocks > 0)
+    ndautocrr.SetErrorBlocks(settings.error_blocks, settings.jackknife);
+
+  // Keep track of the time spent in each phase
+  // (Only the per-thread statistics are costly, so only they are optional.)
+  Profiler profiler;
+  if (settings.profile)
+    ndautocrr.SetProfiler(&profiler);
+  double t_phase = Profiler::Now();  // when did the current phase begin?
+  auto end_phase = [&](const char *name) {
+    double t = Profiler::Now();
+    profiler.AddPhase(name, t - t_phase);
+    t_phase = t;
+  };
+
+  // Report the progress every few seconds (if requested)
+  ProgressReporter progress(log, settings.progress_interval);
+  if (settings.progress_interval > 0.0)
+    ndautocrr.SetProgress(&progress);
+
+  // Add the sums which were saved by previous runs (if any)
+  for (size_t f=0; f < settings.vLoadFilenames.size(); f++) {
+    const string &load_filename = settings.vLoadFilenames[f];
+    ifstream load_file(load_filename.c_str(), ios::binary);
+    if (! load_file)
+      throw InputErr("Error: Unable to open file \"" + load_filename + "\"\n");
+    ndautocrr.Load(load_file, load_filename);
+    log << "# loaded the sums from \"" << load_filename << "\"\n";
+  }
+  if (! settings.vLoadFilenames.empty())
+    end_phase("load");
+
+
+  // now read in the data from the file
+
+  long n_data_sets = 1;
+
+  // Invoke this before processing each data set
+  auto begin_data_set = [&]() {
+    log << "#  processing data set #" << n_data_sets << endl;
+  };
+
+  if ((! in_filename.empty()) && (binary_bytes == 0) &&
+      (in_filename.size() > 4) &&
+      (in_filename.compare(in_filename.size()-4, 4, ".npy") == 0))
+    npy_format = true;
+
+  if (settings.merge_only)
+  {
+    // (Only the saved sums are used.  There is no data to read.)
+  }
+  else if (npy_format || (binary_bytes > 0))
+  {
+    // Binary files are mapped into memory, and the data sets are
+    // processed directly from there (without parsing or copying them).
+    if (in_filename.empty())
+      throw InputErr("Error: Binary input files must be specified using the -in argument.\n");
+    if ((! settings.vColumns.empty()) || (settings.frame_stride > 1))
+      throw InputErr("Error: The -cols and -stride arguments are only used with text input files.\n");
+    if (streaming)
+      throw InputErr("Error: The -stream argument is not available for binary input files.\n");
+
+    MappedFile file(in_filename);
+    vector<size_t> vOffsets;
+    BinaryArray array;
+    if (npy_format)
+      array = ReadNpyArray(file, in_filename, vOffsets);
+    else
+      array = ReadRawArray(file, binary_bytes, binary_D, in_filename);
+    if (! index_filename.empty())
+      ReadIndexFile(index_filename, vOffsets);
+    vector<size_t> vBounds = DataSetBoundaries(vOffsets, array.N);
+    end_phase("map");
+    if (settings.progress_interval > 0.0)
+      progress.Start();
+
+    // Process all of the data sets together (possibly in parallel)
+    vector<DataView<float> > vX32_n;
+    vector<DataView<double> > vX64_n;
+    for (size_t k=0; k+1 < vBounds.size(); k++) {
+      begin_data_set();
+      if (array.pFloat32)
+        vX32_n.push_back(array.view<float>().Slice(vBounds[k], vBounds[k+1]));
+      else
+        vX64_n.push_back(array.view<double>().Slice(vBounds[k], vBounds[k+1]));
+      n_data_sets++;
+    }
+    ndautocrr.Accumulate(vX32_n);
+    ndautocrr.Accumulate(vX64_n);
+    progress.Stop();
+    end_phase("accumulate");
+    log << "# mapped " << file.size() << " bytes (" << array.N
+        << " entries, " << array.D << " columns) from \""
+        << in_filename << "\"\n";
+  }
+  else
+  {
+    ifstream in_file;
+    istream *pIn = &cin;
+    // (Keep track of the file name and line number for error messages.
+    //  These are not shared with other threads.  See "-batch".)
+    string input_name = "standard-input/terminal";
+    long long input_line = 1;
+    if (! in_filename.empty()) {
+      in_file.open(in_filename.c_str());
+      if (! in_file)
+        throw InputErr("Error: Unable to open file \"" + in_filename + "\"\n");
+      pIn = &in_file;
+      input_name = in_filename;
+    }
+    // When the data is read in batches (or streamed), the total amount of
+    // work is not known in advance.  Estimate it from the file size.
+    if ((settings.progress_interval > 0.0) &&
+        (streaming || (! ndautocrr.UsesThreshold()))) {
+      streamoff file_size = 0;
+      if (! in_filename.empty()) {
+        in_file.seekg(0, ios::end);
+        file_size = in_file.tellg();
+        in_file.clear();  // (pipes can not be rewound, so leave them alone)
+        if (file_size > 0)
+          in_file.seekg(0, ios::beg);
+      }
+      else {
+        // (The standard input may be a file, as in "ndautocrr < file".
+        //  In that case, count the bytes which have not been read yet.)
+        struct stat st;
+        if ((fstat(STDIN_FILENO, &st) == 0) && S_ISREG(st.st_mode)) {
+          off_t offset = lseek(STDIN_FILENO, 0, SEEK_CUR);
+          file_size = st.st_size - ((offset > 0) ? offset : 0);
+        }
+      }
+      if (file_size > 0)
+        progress.SetInputSize(file_size);
+      else
+        progress.SetTotalUnknown();  // (for example, reading from a pipe)
+    }
+    if (! index_filename.empty())
+      throw InputErr("Error: The -index argument is only used with binary input files.\n");
+    BufferedReader reader(*pIn, (1 << 20), &input_name, &input_line);
+    if (! settings.vColumns.empty())
+      reader.SelectColumns(settings.vColumns);
+    reader.SetStride(settings.frame_stride);
+    if (settings.progress_interval > 0.0)
+      progress.Start();
+
+    if (streaming) {
+      // Process each line as soon as it is read (without storing the data set)
+      if (L == 0)
+        throw InputErr("Error: The -stream argument requires the -L argument.\n");
+      size_t N_single;  // the number of entries in the current data set
+      do {
+        N_single =
+          reader.template StreamDataSet<Scalar>([&](const Scalar *aX_d, size_t D) {
+              if (! ndautocrr.SeriesStarted()) {
+                begin_data_set();
+                ndautocrr.BeginSeries(D);
+              }
+              ndautocrr.PushFrame(aX_d);
+              progress.SetBytesRead(reader.NumBytesParsed());
+            });
+        if (N_single > 0) {
+          ndautocrr.EndSeries();
+          n_data_sets++;
+        }
+      } while (N_single > 0);
+    }
+    else {
+      // Read the data sets in batches.  The data sets in each batch are
+      // processed together (possibly in parallel).
+      // (When using a threshold, all of the data sets must be processed
+      //  together, because the threshold applies to the combined C(j).)
+      // The data sets are not needed afterwards, so their memory is reused
+      // by ndautocrr (instead of copying them).
+      const size_t max_batch_numbers = (1 << 24);
+      const size_t max_batch_sets = 4096;
+      vector<DataSet<Scalar> > vX_n(1); // the current batch of data sets
+      size_t batch_numbers = 0;
+      while (reader.ReadDataSet(vX_n.back()))
+      {
+        begin_data_set();
+        n_data_sets++;
+        progress.SetBytesRead(reader.NumBytesParsed());
+        batch_numbers += vX_n.back().size() * vX_n.back().dim();
+        if ((! ndautocrr.UsesThreshold()) &&
+            ((batch_numbers >= max_batch_numbers) ||
+             (vX_n.size() >= max_batch_sets))) {
+          ndautocrr.Accumulate(std::move(vX_n));
+          vX_n.resize(0);
+          batch_numbers = 0;
+        }
+        vX_n.push_back(DataSet<Scalar>());
+      }
+      vX_n.pop_back();  // (the last entry is empty)
+      ndautocrr.Accumulate(std::move(vX_n));
+    }
+    progress.Stop();
+
+    // (The time spent parsing was interleaved with the other calculations.)
+    reader.ReportThroughput(log);
+    profiler.AddParsed(reader.NumBytes(), reader.NumValues(), reader.ParseTime());
+    profiler.AddPhase("parse", reader.ParseTime());
+    t_phase += reader.ParseTime();
+    end_phase("accumulate");
+  }
+
+  if ((n_data_sets == 1) && settings.vLoadFilenames.empty())
+    throw InputErr("Error: The input does not contain any data.\n");
+
+  if ((! streaming) && (n_data_sets > 1))
+    ReportEngines(ndautocrr, log);
+
+  if (! settings.save_filename.empty()) {
+    // Save the sums (before they are normalized), so that they can be
+    // combined with other sums later (using "-load" or "-merge").
+    ofstream save_file(settings.save_filename.c_str(), ios::binary);
+    if (! save_file)
+      throw InputErr("Error: Unable to create file \"" + settings.save_filename + "\"\n");
+    ndautocrr.Save(save_file);
+    log << "# saved the sums to \"" << settings.save_filename << "\"\n";
+    end_phase("save");
+  }
+
+  ndautocrr.Finalize();
+  end_phase("finalize");
+
+
+  //Now print the corrlation function to the standard out
+  //assert(L <= vCsum.size());
+
+  const vector<pair<size_t, size_t> > &vPairs = ndautocrr.CrossPairs();
+  if (settings.cross) {
+    log << "#----- delta";
+    for (size_t p=0; p < vPairs.size(); p++)
+      log << "  C_" << vPairs[p].first+1 << "," << vPairs[p].second+1
+          << "(delta)";
+    log << " -----\n" << endl;
+  }
+  else if (settings.per_column) {
+    log << "#----- delta";
+    for (size_t p=0; p < vPairs.size(); p++)
+      log << "  C_" << vPairs[p].first+1 << "(delta)";
+    log << " -----\n" << endl;
+  }
+  else if (settings.error_blocks > 0)
+    log << "#----- delta  C(delta)  error(delta) -----\n" << endl;
+  else
+    log << "#----- delta  C(delta) -----\n" << endl;
+
+  if ((settings.error_blocks > 0) && (ndautocrr.NumErrorBlocks() < 2))
+    throw InputErr("Error: Estimating the uncertainty requires at least 2 blocks.\n"
+                   "       (Use more data sets, or \"-err B\" to divide each data set\n"
+                   "        into B blocks.)\n");
+
+  L = ndautocrr.size();
+
+  // Each line contains j, followed by these columns (and, optionally, the
+  // number of samples)
+  vector<const vector<double>*> vpColumns;
+  if (settings.cross || settings.per_column) {
+    // print C_ab(j) for each pair of columns (or C_d(j) for each column)
+    for (size_t p=0; p < ndautocrr.vvCpair.size(); p++)
+      vpColumns.push_back(&ndautocrr.vvCpair[p]);
+  }
+  else
+    vpColumns.push_back(&ndautocrr.vC);
+  if (settings.error_blocks > 0)
+    vpColumns.push_back(&ndautocrr.vCerr);
+  if (report_rms)
+    vpColumns.push_back(&ndautocrr.vCrms);
+
+  size_t num_rows = WriteTable(out,
+                               ChooseOutputLags(L,
+                                                settings.out_stride,
+                                                settings.out_per_decade),
+                               nullptr,
+                               vpColumns,
+                               ndautocrr.vNumSamples,
+                               report_nsum,
+                               settings.out_npy_filename);
+  if (! settings.out_npy_filename.empty())
+    log << "# wrote " << num_rows << " lags to \""
+        << settings.out_npy_filename << "\"\n";
+
+  // Now print back the corrlation length
+  double correlation_length = ndautocrr.GuessCorrelationLength();
+
+  log <<
+    "\n"
+    "#--------------------------------------\n"
+    "# correlation length = " << correlation_length
+    // << "\n"
+    //"# g = 1 + 2*(correlation length) = "
+    //   << 1.0 + (2.0*correlation_length)
+       << endl;
+
+  if (settings.error_blocks > 0)
+    log << "# correlation length error = " << ndautocrr.CorrelationLengthError()
+        << "  (" << (settings.jackknife ? "jackknife, " : "")
+        << ndautocrr.NumErrorBlocks() << " blocks)" << endl;
+
+  if (settings.per_column) {
+    // Print the correlation length of each column (separately)
+    for (size_t p=0; p < vPairs.size(); p++)
+      log << "# correlation length (column " << vPairs[p].first+1 << ") = "
+          << ndautocrr.GuessCorrelationLength(ndautocrr.vvCpair[p]) << "\n";
+    log << flush;
+  }
+
+  out.flush();
+  end_phase("output");
+  ReportProfile(profiler, settings, log);
+
+  RunSummary summary;
+  summary.num_data_sets = n_data_sets - 1;
+  summary.correlation_length = correlation_length;
+  if (settings.error_blocks > 0)
+    summary.correlation_length_error = ndautocrr.CorrelationLengthError();
+  return summary;
+} //Run()
+
+
+
+/// @brief  Read the data and calculate the correlation function at
+///         logarithmically spaced separations (using MultiTauCorrelator).
+///         The data is never stored: each entry is processed as soon as
+///         it is read.
+template<typename Scalar>
+RunSummary
+RunMultiTau(const Settings &settings,
+            ostream &out = cout, //!< print the correlation function here
+            ostream &log = cerr) //!< print everything else here
+{
+  const string &in_filename = settings.in_filename;
+  bool npy_format = settings.npy_format;
+
+  MultiTauCorrelator<Scalar> correlator(settings.multitau_p,
+                                        2,
+                                        settings.L,
+                                        settings.threshold,
+                                        settings.subtract_ave);
+
+  long n_data_sets = 1;
+
+  // Keep track of the time spent in each phase (see Run())
+  Profiler profiler;
+  double t_phase = Profiler::Now();
+  auto end_phase = [&](const char *name) {
+    double t = Profiler::Now();
+    profiler.AddPhase(name, t - t_phase);
+    t_phase = t;
+  };
+
+  if ((! in_filename.empty()) && (settings.binary_bytes == 0) &&
+      (in_filename.size() > 4) &&
+      (in_filename.compare(in_filename.size()-4, 4, ".npy") == 0))
+    npy_format = true;
+
+  if (npy_format || (settings.binary_bytes > 0))
+  {
+    if (in_filename.empty())
+      throw InputErr("Error: Binary input files must be specified using the -in argument.\n");
+    if ((! settings.vColumns.empty()) || (settings.frame_stride > 1))
+      throw InputErr("Error: The -cols and -stride arguments are only used with text input files.\n");
+    MappedFile file(in_filename);
+    vector<size_t> vOffsets;
+    BinaryArray array;
+    if (npy_format)
+      array = ReadNpyArray(file, in_filename, vOffsets);
+    else
+      array = ReadRawArray(file, settings.binary_bytes, settings.binary_D,
+                           in_filename);
+    if (! settings.index_filename.empty())
+      ReadIndexFile(settings.index_filename, vOffsets);
+    vector<size_t> vBounds = DataSetBoundaries(vOffsets, array.N);
+    end_phase("map");
+
+    DataView<float>  x32 = array.view<float>();
+    DataView<double> x64 = array.view<double>();
+    vector<Scalar> aX_d(array.D);
+    for (size_t k=0; k+1 < vBounds.size(); k++) {
+      log << "#  processing data set #" << n_data_sets << endl;
+      correlator.BeginSeries(array.D);
+      for (size_t i=vBounds[k]; i < vBounds[k+1]; i++) {
+        for (size_t d=0; d < array.D; d++)
+          aX_d[d] = array.pFloat32 ? x32(i, d) : x64(i, d);
+        correlator.PushFrame(aX_d.data());
+      }
+      correlator.EndSeries();
+      n_data_sets++;
+    }
+    end_phase("accumulate");
+    log << "# mapped " << file.size() << " bytes (" << array.N
+        << " entries, " << array.D << " columns) from \""
+        << in_filename << "\"\n";
+  }
+  else
+  {
+    ifstream in_file;
+    istream *pIn = &cin;
+    // (Keep track of the file name and line number for error messages.
+    //  These are not shared with other threads.  See "-batch".)
+    string input_name = "standard-input/terminal";
+    long long input_line = 1;
+    if (! in_filename.empty()) {
+      in_file.open(in_filename.c_str());
+      if (! in_file)
+        throw InputErr("Error: Unable to open file \"" + in_filename + "\"\n");
+      pIn = &in_file;
+      input_name = in_filename;
+    }
+    if (! settings.index_filename.empty())
+      throw InputErr("Error: The -index argument is only used with binary input files.\n");
+    BufferedReader reader(*pIn, (1 << 20), &input_name, &input_line);
+    if (! settings.vColumns.empty())
+      reader.SelectColumns(settings.vColumns);
+    reader.SetStride(settings.frame_stride);
+
+    // Process each line as soon as it is read
+    size_t N_single;  // the number of entries in the current data set
+    do {
+      N_single =
+        reader.template StreamDataSet<Scalar>([&](const Scalar *aX_d, size_t D) {
+            if (! correlator.SeriesStarted()) {
+              log << "#  processing data set #" << n_data_sets << endl;
+              correlator.BeginSeries(D);
+            }
+            correlator.PushFrame(aX_d);
+          });
+      if (N_single > 0) {
+        correlator.EndSeries();
+        n_data_sets++;
+      }
+    } while (N_single > 0);
+
+    reader.ReportThroughput(log);
+    profiler.AddParsed(reader.NumBytes(), reader.NumValues(), reader.ParseTime());
+    profiler.AddPhase("parse", reader.ParseTime());
+    t_phase += reader.ParseTime();
+    end_phase("accumulate");
+  }
+
+  if (n_data_sets == 1)
+    throw InputErr("Error: The input does not contain any data.\n");
+
+  correlator.Finalize();
+  end_phase("finalize");
+
+  log << "#----- delta  C(delta) -----\n" << endl;
+  vector<size_t> vRows(correlator.vC.size());
+  for (size_t b=0; b < vRows.size(); b++)
+    vRows[b] = b;
+  size_t num_rows = WriteTable(out,
+                               vRows,
+                               &correlator.vLag,
+                               {&correlator.vC},
+                               correlator.vNumSamples,
+                               settings.report_nsum,
+                               settings.out_npy_filename);
+  if (! settings.out_npy_filename.empty())
+    log << "# wrote " << num_rows << " lags to \""
+        << settings.out_npy_filename << "\"\n";
+
+  double correlation_length = correlator.GuessCorrelationLength();
+  log <<
+    "\n"
+    "#--------------------------------------\n"
+    "# correlation length = " << correlation_length
+       << endl;
+
+  out.flush();
+  end_phase("output");
+  ReportProfile(profiler, settings, log);
+
+  RunSummary summary;
+  summary.num_data_sets = n_data_sets - 1;
+  summary.correlation_length = correlation_length;
+  return summary;
+} //RunMultiTau()
+
+
+
+/// @brief  Process each file in settings.vBatchFilenames separately
+///         (see "-batch").  The correlation function of each file is written
+///         to a file with the same name ending in ".crr".  The messages which
+///         would have been printed to the terminal (including the correlation
+///         length) are written to a file ending in ".crr.log".
+///         Several files are processed at the same time.  (If there are more
+///         threads than files, the remaining threads are used to process the
+///         lags within each file.)  Finally, a table containing the
+///         correlation length of every file is printed to the standard output.
+template<typename Scalar>
+void
+RunBatch(const Settings &settings)
+{
+  const vector<string> &vFilenames = settings.vBatchFilenames;
+  size_t num_files = vFilenames.size();
+  vector<RunSummary> vSummary(num_files);
+  vector<string> vErrors(num_files);  // (empty unless an error occurred)
+
+  // (Read the engine cost model once, rather than once per file.  If it
+  //  must be measured, that only happens once.  See LoadCostModel().)
+  Settings batch_settings = settings;
+  LoadEngineModel<Scalar>(batch_settings, cerr);
+
+  // Divide the threads between the files and the lags (within each file)
+  #ifndef DISABLE_OPENMP
+  int num_threads = omp_get_max_threads();
+  int outer_threads = min(static_cast<size_t>(num_threads), num_files);
+  int inner_threads = max(1, num_threads / outer_threads);
+  omp_set_max_active_levels(2);
+  #endif
+
+  #ifndef DISABLE_OPENMP
+  #pragma omp parallel for schedule(dynamic, 1) num_threads(outer_threads)
+  #endif
+  for (size_t f=0; f < num_files; f++) {
+    #ifndef DISABLE_OPENMP
+    omp_set_num_threads(inner_threads);
+    #endif
+    Settings file_settings = batch_settings;
+    file_settings.in_filename = vFilenames[f];
+    string out_filename = vFilenames[f] + ".crr";
+    string log_filename = out_filename + ".log";
+    // (Exceptions can not leave a parallel region, so they are reported later.)
+    try {
+      ofstream out_file(out_filename.c_str());
+      if (! out_file)
+        throw InputErr("Error: Unable to create file \"" + out_filename + "\"\n");
+      ofstream log_file(log_filename.c_str());
+      if (! log_file)
+        throw InputErr("Error: Unable to create file \"" + log_filename + "\"\n");
+      if (settings.multitau)
+        vSummary[f] = RunMultiTau<Scalar>(file_settings, out_file, log_file);
+      else
+        vSummary[f] = Run<Scalar>(file_settings, out_file, log_file);
+    }
+    catch (const std::exception &e) {
+      vErrors[f] = e.what();
+    }
+    #pragma omp critical
+    {
+      if (vErrors[f].empty())
+        cerr << "#  finished \"" << vFilenames[f] << "\" (see \""
+             << out_filename << "\")" << endl;
+      else
+        cerr << "#  failed to process \"" << vFilenames[f] << "\":\n"
+             << vErrors[f] << flush;
+    }
+  }
+
+  // Print the correlation length of each file
+  bool report_error = (settings.error_blocks > 0);
+  cerr << "\n#----- file  data_sets  correlation_length"
+       << (report_error ? "  correlation_length_error" : "") << " -----\n"
+       << endl;
+  size_t num_failed = 0;
+  for (size_t f=0; f < num_files; f++) {
+    if (! vErrors[f].empty()) {
+      num_failed++;
+      continue;
+    }
+    cout << vFilenames[f] << " " << vSummary[f].num_data_sets
+         << " " << vSummary[f].correlation_length;
+    if (report_error)
+      cout << " " << vSummary[f].correlation_length_error;
+    cout << "\n";
+  }
+  cout.flush();
+
+  if (num_failed > 0) {
+    stringstream err_msg;
+    err_msg << "Error: " << num_failed << " of " << num_files
+            << " files could not be processed (see above).\n";
+    throw InputErr(err_msg.str());
+  }
+} //RunBatch()
+
+
+
+/// @brief  Append the names of the files matching a pattern (which may contain
+///         wildcards like "*", "?", or "[...]") to vFilenames.  (If no files
+///         match, the pattern is appended unchanged.)
+void
+ExpandFilenames(const string &pattern, vector<string> &vFilenames)
+{
+  if (pattern.find_first_of("*?[") == string::npos) {
+    vFilenames.push_back(pattern);
+    return;
+  }
+  glob_t matches;
+  int status = glob(pattern.c_str(), 0, nullptr, &matches);
+  if (status == 0) {
+    for (size_t k=0; k < matches.gl_pathc; k++)
+      vFilenames.push_back(matches.gl_pathv[k]);
+  }
+  else
+    vFilenames.push_back(pattern);
+  globfree(&matches);
+}
+
+
+
 int
 main(int argc, char **argv)
 {
@@ -38,6 +813,7 @@ main(int argc, char **argv)
 
     bool is_periodic = false;
     size_t L = 0; // an impossible starting value
+    bool single_precision = false; // store the data using float32?
 
     // Now parse the argument list:
 
@@ -45,6 +821,32 @@ main(int argc, char **argv)
     bool subtract_ave = true;
     bool report_rms = false;
     bool report_nsum = false;
+    bool streaming = false;
+    string in_filename;        // read from this file (instead of stdin)?
+    string index_filename;     // file storing the offsets of each data set
+    size_t binary_bytes = 0;   // 4 or 8 for raw float32/float64 files
+    size_t binary_D = 0;       // the number of columns (for raw files)
+    bool npy_format = false;   // is the input file a NumPy ".npy" file?
+    string engine = "auto";    // "auto", "direct", or "fft"
+    bool cross = false;        // report cross-correlations between columns?
+    bool per_column = false;   // report the autocorrelation of each column?
+    vector<pair<size_t, size_t> > vPairs; // (the pairs of columns)
+    size_t error_blocks = 0;   // estimate errors using blocks? (0 = no)
+    bool jackknife = false;    // estimate errors using the jackknife?
+    bool multitau = false;     // use the multi-tau (logarithmic-lag) correlator?
+    string save_filename;      // save the (un-normalized) sums to this file?
+    vector<string> vLoadFilenames; // add the sums saved in these files
+    bool merge_only = false;   // do not read any data (only the saved sums)?
+    size_t multitau_p = 16;    // the number of bins per level (multi-tau only)
+    bool profile = false;      // report the time spent in each phase?
+    string profile_json_filename; // also write the profile to this file?
+    double progress_interval = 0.0; // report the progress? (seconds, 0=no)
+    string out_npy_filename;   // write the results to a ".npy" file instead?
+    size_t out_stride = 1;     // print every out_stride'th lag
+    double out_per_decade = 0.0; // print lags spaced logarithmically? (0=no)
+    vector<string> vBatchFilenames; // process each of these files separately?
+    vector<size_t> vColumns;   // only read these columns? (empty = all)
+    size_t frame_stride = 1;   // only read every frame_stride'th entry
 
     {
       bool syntax_error_occured = false;
@@ -90,6 +892,252 @@ main(int argc, char **argv)
           report_nsum = true;
           ndelete = 1;
         }
+        else if (strcmp(argv[i], "-stream")==0)
+        {
+          streaming = true;
+          ndelete = 1;
+        }
+        else if ((strcmp(argv[i], "-in")==0) ||
+                 (strcmp(argv[i], "-index")==0))
+        {
+          if (argc <= i+1)
+            throw InputErr(string("Error: Expected a file name following the ") +
+                           argv[i] + " argument.\n");
+          if (strcmp(argv[i], "-in")==0)
+            in_filename = argv[i+1];
+          else
+            index_filename = argv[i+1];
+          ndelete = 2;
+        }
+        else if ((strcmp(argv[i], "-float32")==0) ||
+                 (strcmp(argv[i], "-float64")==0))
+        {
+          if ((argc <= i+1) || (! isdigit(argv[i+1][0])) ||
+              (atoi(argv[i+1]) <= 0))
+            throw InputErr(string("Error: Expected a positive integer (the number of columns)\n"
+                                  "       following the ") + argv[i] + " argument.\n");
+          binary_bytes = (strcmp(argv[i], "-float32")==0) ? 4 : 8;
+          binary_D = atoi(argv[i+1]);
+          ndelete = 2;
+        }
+        else if (strcmp(argv[i], "-npy")==0)
+        {
+          npy_format = true;
+          ndelete = 1;
+        }
+        else if (strcmp(argv[i], "-fft")==0)
+        {
+          engine = "fft";
+          ndelete = 1;
+        }
+        else if (strcmp(argv[i], "-engine")==0)
+        {
+          if ((argc <= i+1) ||
+              ((strcmp(argv[i+1], "auto") != 0) &&
+               (strcmp(argv[i+1], "direct") != 0) &&
+               (strcmp(argv[i+1], "fft") != 0)))
+            throw InputErr("Error: Expected \"auto\", \"direct\", or \"fft\" following the -engine argument.\n");
+          engine = argv[i+1];
+          ndelete = 2;
+        }
+        else if (strcmp(argv[i], "-cross")==0)
+        {
+          cross = true;
+          ndelete = 1;
+        }
+        else if (strcmp(argv[i], "-percolumn")==0)
+        {
+          per_column = true;
+          ndelete = 1;
+        }
+        else if (strcmp(argv[i], "-pair")==0)
+        {
+          if ((argc <= i+2) ||
+              (! isdigit(argv[i+1][0])) || (atoi(argv[i+1]) <= 0) ||
+              (! isdigit(argv[i+2][0])) || (atoi(argv[i+2]) <= 0))
+            throw InputErr("Error: Expected two column numbers (starting at 1) following -pair\n");
+          cross = true;
+          vPairs.push_back(make_pair(atoi(argv[i+1]) - 1,
+                                     atoi(argv[i+2]) - 1));
+          ndelete = 3;
+        }
+        else if ((strcmp(argv[i], "-err")==0) ||
+                 (strcmp(argv[i], "-jackknife")==0))
+        {
+          if (strcmp(argv[i], "-jackknife")==0)
+            jackknife = true;
+          if (error_blocks == 0)
+            error_blocks = 1; // (by default, each data set is one block)
+          ndelete = 1;
+          // (The number of blocks per data set is optional.)
+          if ((argc > i+1) && isdigit(argv[i+1][0])) {
+            if (atoi(argv[i+1]) <= 0)
+              throw InputErr(string("Error: The number following ") + argv[i] +
+                             " must be a positive integer.\n");
+            error_blocks = atoi(argv[i+1]);
+            ndelete = 2;
+          }
+        }
+        else if ((strcmp(argv[i], "-save")==0) ||
+                 (strcmp(argv[i], "-load")==0))
+        {
+          if (argc <= i+1)
+            throw InputErr(string("Error: Expected a file name following the ") +
+                           argv[i] + " argument.\n");
+          if (strcmp(argv[i], "-save")==0)
+            save_filename = argv[i+1];
+          else
+            vLoadFilenames.push_back(argv[i+1]);
+          ndelete = 2;
+        }
+        else if (strcmp(argv[i], "-merge")==0)
+        {
+          // (All of the arguments which follow (until the next argument
+          //  beginning with '-') are file names.)
+          merge_only = true;
+          ndelete = 1;
+          while ((i+ndelete < argc) && (argv[i+ndelete][0] != '-')) {
+            vLoadFilenames.push_back(argv[i+ndelete]);
+            ndelete++;
+          }
+          if (ndelete == 1)
+            throw InputErr("Error: Expected one or more file names following the -merge argument.\n");
+        }
+        else if (strcmp(argv[i], "-batch")==0)
+        {
+          // (All of the arguments which follow (until the next argument
+          //  beginning with '-') are file names, or wildcard patterns.)
+          ndelete = 1;
+          while ((i+ndelete < argc) && (argv[i+ndelete][0] != '-')) {
+            ExpandFilenames(argv[i+ndelete], vBatchFilenames);
+            ndelete++;
+          }
+          if (ndelete == 1)
+            throw InputErr("Error: Expected one or more file names following the -batch argument.\n");
+        }
+        else if (strcmp(argv[i], "-batchlist")==0)
+        {
+          // (The file names (or wildcard patterns) are stored in a text
+          //  file, separated by whitespace.)
+          if (argc <= i+1)
+            throw InputErr("Error: Expected a file name following the -batchlist argument.\n");
+          ifstream list_file(argv[i+1]);
+          if (! list_file)
+            throw InputErr(string("Error: Unable to open file \"") + argv[i+1] + "\"\n");
+          string pattern;
+          while (list_file >> pattern)
+            ExpandFilenames(pattern, vBatchFilenames);
+          ndelete = 2;
+        }
+        else if (strcmp(argv[i], "-multitau")==0)
+        {
+          multitau = true;
+          ndelete = 1;
+          // (The number of bins per level is optional.)
+          if ((argc > i+1) && isdigit(argv[i+1][0])) {
+            multitau_p = atoi(argv[i+1]);
+            ndelete = 2;
+          }
+        }
+        else if ((strcmp(argv[i], "-profile")==0) ||
+                 (strcmp(argv[i], "--profile")==0))
+        {
+          profile = true;
+          ndelete = 1;
+        }
+        else if ((strcmp(argv[i], "-profile-json")==0) ||
+                 (strcmp(argv[i], "--profile-json")==0))
+        {
+          if (argc <= i+1)
+            throw InputErr(string("Error: Expected a file name following the ") +
+                           argv[i] + " argument.\n");
+          profile = true;
+          profile_json_filename = argv[i+1];
+          ndelete = 2;
+        }
+        else if ((strcmp(argv[i], "-progress")==0) ||
+                 (strcmp(argv[i], "--progress")==0))
+        {
+          progress_interval = 10.0;
+          ndelete = 1;
+          // (The interval between reports (in seconds) is optional.)
+          if ((argc > i+1) &&
+              (isdigit(argv[i+1][0]) || (argv[i+1][0] == '.'))) {
+            progress_interval = atof(argv[i+1]);
+            ndelete = 2;
+          }
+          if (! (progress_interval > 0.0))
+            throw InputErr("Error: The interval following the -progress argument must be positive.\n");
+        }
+        else if (strcmp(argv[i], "-cols")==0)
+        {
+          // The columns are numbered from 1, separated by commas, and
+          // may include ranges, for example "-cols 2,5-7"
+          if (argc <= i+1)
+            throw InputErr("Error: Expected a list of columns following the -cols argument\n"
+                           "       (for example \"-cols 2,5-7\").\n");
+          string list = argv[i+1];
+          replace(list.begin(), list.end(), ',', ' ');
+          stringstream list_ss(list);
+          string range;
+          while (list_ss >> range) {
+            size_t first = 0, last = 0;
+            char dash;
+            stringstream range_ss(range);
+            if (! (range_ss >> first))
+              first = 0;
+            last = first;
+            if (range_ss >> dash) {
+              if ((dash != '-') || (! (range_ss >> last)))
+                last = 0;
+            }
+            if ((first == 0) || (last < first) || (range_ss >> dash))
+              throw InputErr("Error: Unable to understand \"" + range + "\" following the -cols argument.\n"
+                             "       (Expected a list of column numbers, starting at 1, for example \"2,5-7\")\n");
+            for (size_t c=first; c <= last; c++) {
+              if (find(vColumns.begin(), vColumns.end(), c-1) != vColumns.end())
+                throw InputErr("Error: Each column can only appear once following the -cols argument.\n");
+              vColumns.push_back(c-1);
+            }
+          }
+          if (vColumns.empty())
+            throw InputErr("Error: Expected a list of columns following the -cols argument.\n");
+          ndelete = 2;
+        }
+        else if (strcmp(argv[i], "-stride")==0)
+        {
+          if ((argc <= i+1) || (atol(argv[i+1]) <= 0))
+            throw InputErr("Error: Expected a positive integer following the -stride argument.\n");
+          frame_stride = atol(argv[i+1]);
+          ndelete = 2;
+        }
+        else if (strcmp(argv[i], "-outnpy")==0)
+        {
+          if (argc <= i+1)
+            throw InputErr("Error: Expected a file name following the -outnpy argument.\n");
+          out_npy_filename = argv[i+1];
+          ndelete = 2;
+        }
+        else if (strcmp(argv[i], "-outstride")==0)
+        {
+          if ((argc <= i+1) || (atol(argv[i+1]) <= 0))
+            throw InputErr("Error: Expected a positive integer following the -outstride argument.\n");
+          out_stride = atol(argv[i+1]);
+          ndelete = 2;
+        }
+        else if (strcmp(argv[i], "-outlog")==0)
+        {
+          if ((argc <= i+1) || (! (atof(argv[i+1]) > 0.0)))
+            throw InputErr("Error: Expected a positive number following the -outlog argument\n"
+                           "       (the number of lags printed per decade).\n");
+          out_per_decade = atof(argv[i+1]);
+          ndelete = 2;
+        }
+        else if (strcmp(argv[i], "-single")==0)
+        {
+          single_precision = true;
+          ndelete = 1;
+        }
         else if ((strcmp(argv[i], "-t")==0) ||
                  (strcmp(argv[i], "-T")==0) ||
                  (strcmp(argv[i], "-threshold")==0) ||
@@ -153,106 +1201,94 @@ main(int argc, char **argv)
     }
 
 
-    // allocate the array to store the auto-correlation function
-
-    NdAutocrr<double>
-      ndautocrr = NdAutocrr<double>(threshold,
-                                    L,
-                                    is_periodic,
-                                    subtract_ave,
-                                    report_rms);
-
-
-    // now read in the data from the file
-
-    long n_data_sets = 1;
-    vector<double> vX_d;
-    vector<vector<double> > vvX_id;
-    g_filename.assign("standard-input/terminal");
-    g_line=1;           //keep track of which line number
-    Skip(cin, g_spaces_and_newlines);
-    long prev_line = g_line; //used to figure out if 2 numbers on same line
-    long L_min = -1;
-    while(cin)
-    {
-      double x;
-      //cin >> x;
-      x = ReadScalar<double>(cin, g_spaces_and_newlines);
-      if (! cin) break;
-      assert(g_line == prev_line);
-      vX_d.push_back(x);
-
-      if (cin) Skip(cin, g_spaces_and_newlines);
-      //did the line number increment or not?
-      if (g_line > prev_line) {
-        assert(vX_d.size() > 0);
-        vvX_id.push_back(vX_d);
-        vX_d.resize(0);
-      }
-      if (g_line - prev_line > 1) {
-        if (vvX_id.size() > 0) {
-          cerr << "#  processing data set #" << n_data_sets << endl;
-          if ((n_data_sets > 1) && (threshold > -1.0)) {
-            throw InputErr("ERROR: Do not use -threshold when analyzing files containing multiple data\n"
-                           "       sets separated by blank lines (sometimes also called \"trajectories\").\n"
-                           "       Use the -L argument instead.\n");
-          }
-
-          ndautocrr.AccumulateSingle(vvX_id);
-          n_data_sets++;
-        }
-        vvX_id.resize(0);
-      }
-      prev_line = g_line;
-    }
-
-    if (vvX_id.size() > 0) {
-      cerr << "#  processing data set #" << n_data_sets << endl;
-      if ((n_data_sets > 1) && (threshold > -1.0)) {
-        throw InputErr("ERROR: Do not use -threshold when analyzing files containing multiple data\n"
-                       "       sets separated by blank lines (sometimes also called \"trajectories\").\n"
-                       "       Use the -L argument instead.\n");
-      }
-
-      ndautocrr.AccumulateSingle(vvX_id);
-      n_data_sets++;
-    }
-
+    Settings settings;
+    settings.is_periodic = is_periodic;
+    settings.L = L;
+    settings.threshold = threshold;
+    settings.subtract_ave = subtract_ave;
+    settings.report_rms = report_rms;
+    settings.report_nsum = report_nsum;
+    settings.streaming = streaming;
+    settings.engine = engine;
+    settings.in_filename = in_filename;
+    settings.index_filename = index_filename;
+    settings.binary_bytes = binary_bytes;
+    settings.binary_D = binary_D;
+    settings.npy_format = npy_format;
+    settings.cross = cross;
+    settings.per_column = per_column;
+    settings.vPairs = vPairs;
+    settings.error_blocks = error_blocks;
+    settings.jackknife = jackknife;
+    settings.multitau = multitau;
+    settings.multitau_p = multitau_p;
+    settings.save_filename = save_filename;
+    settings.vLoadFilenames = vLoadFilenames;
+    settings.merge_only = merge_only;
+    settings.profile = profile;
+    settings.profile_json_filename = profile_json_filename;
+    settings.progress_interval = progress_interval;
+    settings.out_npy_filename = out_npy_filename;
+    settings.out_stride = out_stride;
+    settings.out_per_decade = out_per_decade;
+    settings.vBatchFilenames = vBatchFilenames;
+    settings.vColumns = vColumns;
+    settings.frame_stride = frame_stride;
 
-    ndautocrr.Finalize();
+    if (cross && per_column)
+      throw InputErr("Error: The -percolumn argument can not be used with -cross or -pair.\n");
+    if ((cross || per_column) && report_rms)
+      throw InputErr("Error: The -rms argument can not be used with -cross, -pair,\n"
+                     "       or -percolumn.\n");
+    if ((cross || per_column) && streaming)
+      throw InputErr("Error: The -stream argument can not be used with -cross, -pair,\n"
+                     "       or -percolumn.\n");
 
+    if ((error_blocks > 0) && (cross || per_column || multitau))
+      throw InputErr("Error: The -err and -jackknife arguments can not be used with -cross,\n"
+                     "       -pair, -percolumn, or -multitau.\n");
+    if ((error_blocks > 1) && (engine == "fft"))
+      throw InputErr("Error: \"-err B\" (with B > 1) can not be used with -fft.\n");
+    if ((error_blocks > 1) && streaming)
+      throw InputErr("Error: \"-err B\" (with B > 1) can not be used with -stream.\n");
 
-    //Now print the corrlation function to the standard out
-    //assert(L <= vCsum.size());
+    if ((! save_filename.empty() || ! vLoadFilenames.empty()) && (L == 0))
+      throw InputErr("Error: The -save, -load, and -merge arguments require the -L argument.\n");
+    if ((! save_filename.empty() || ! vLoadFilenames.empty()) && multitau)
+      throw InputErr("Error: The -save, -load, and -merge arguments can not be used with -multitau.\n");
+    if (merge_only && (! in_filename.empty()))
+      throw InputErr("Error: The -merge argument can not be used with -in (use -load instead).\n");
 
-    cerr << "#----- delta  C(delta) -----\n" << endl;
+    if (multitau && (is_periodic || report_rms || (engine == "fft") ||
+                     cross || per_column))
+      throw InputErr("Error: The -multitau argument can not be used with -p, -rms, -fft,\n"
+                     "       -cross, -pair, or -percolumn.\n");
 
-    L = ndautocrr.size();
+    if ((out_stride > 1) && (out_per_decade > 0.0))
+      throw InputErr("Error: The -outstride and -outlog arguments can not be used together.\n");
+    if (multitau && ((out_stride > 1) || (out_per_decade > 0.0)))
+      throw InputErr("Error: The -outstride and -outlog arguments can not be used with -multitau.\n"
+                     "       (Its lags are already spaced logarithmically.)\n");
 
-    for (size_t j=0; j <= L; ++j)
-    {
-      if (ndautocrr.vNumSamples[j] > 0) {
-        cout << j
-             << " " << ndautocrr.vC[j];
-        if (report_rms)
-          cout << " " << ndautocrr.vCrms[j];
-        if (report_nsum)
-          cout << " " << ndautocrr.vNumSamples[j];
-        cout << "\n";
-      }
-    }
+    if ((! vBatchFilenames.empty()) &&
+        ((! in_filename.empty()) || (! index_filename.empty()) ||
+         (! save_filename.empty()) || (! vLoadFilenames.empty()) ||
+         (! out_npy_filename.empty()) || profile || (progress_interval > 0.0)))
+      throw InputErr("Error: The -batch argument can not be used with -in, -index, -save,\n"
+                     "       -load, -merge, -outnpy, -profile, or -progress.\n");
 
-    // Now print back the corrlation length
-    double correlation_length = ndautocrr.GuessCorrelationLength();
-
-    cerr <<
-      "\n"
-      "#--------------------------------------\n"
-      "# correlation length = " << correlation_length
-      // << "\n"
-      //"# g = 1 + 2*(correlation length) = "
-      //   << 1.0 + (2.0*correlation_length)
-         << endl;
+    if ((! vBatchFilenames.empty()) && single_precision)
+      RunBatch<float>(settings);
+    else if (! vBatchFilenames.empty())
+      RunBatch<double>(settings);
+    else if (multitau && single_precision)
+      RunMultiTau<float>(settings);
+    else if (multitau)
+      RunMultiTau<double>(settings);
+    else if (single_precision)
+      Run<float>(settings);
+    else
+      Run<double>(settings);
 
   } // try
   catch (const std::exception& e) {
@@ -0,0 +1,378 @@
+///   @file multitau.hpp
+///   @brief  A "multiple-tau" (logarithmic-lag) correlator, which estimates
+///           C(j) at logarithmically spaced separations (j) while reading
+///           the data one entry at a time.  Both the memory required and the
+///           cost per entry are independent of the length of the data set
+///           (and grow only logarithmically with the largest separation).
+///           (See: Ramirez, Sukumaran, Vorselaars, Likhtman,
+///            J. Chem. Phys. 133, 154103 (2010))
+
+#ifndef _MULTITAU_HPP
+#define _MULTITAU_HPP
+
+#include <vector>
+#include <cassert>
+#define _USE_MATH_DEFINES
+#include <cmath>
+using namespace std;
+#include "err.hpp"
+#include "inner_product.h"
+
+
+
+/// @brief  The data is stored in a hierarchy of "levels".  Level 0 stores the
+///         most recent p entries, x(i).  Level k stores the most recent p
+///         averages of m^k consecutive entries.  Each time a new value
+///         arrives at level k, it is multiplied with the previous values at
+///         that level, contributing to C(j) at the separations j = s*m^k
+///         (where p/m <= s < p, or 0 <= s < p at level 0).
+///         Each (level, s) pair is a "bin" with a fixed separation.
+///         At level 0, the results are identical to the direct method.
+///         At higher levels, C(j) is computed from averaged data, which
+///         smooths C(j) over a window of width m^k.
+///
+///         Usage: BeginSeries(), PushFrame() (once per entry), EndSeries(),
+///         repeated for each data set.  Then Finalize().  The results are
+///         stored in vLag[b], vC[b], and vNumSamples[b] for each bin b.
+
+template<typename Scalar>
+
+class MultiTauCorrelator {
+
+  size_t p;            // the number of bins at each level
+  size_t m;            // the number of values averaged when moving up a level
+  size_t max_lag;      // ignore separations larger than this (0 = no limit)
+  size_t max_levels;   // the number of levels needed to reach max_lag
+  double threshold;    // discard C(j) after it drops below threshold*C(0)
+  double persistence_length_threshold; //used for calculating persistence length
+  bool subtract_ave;   // subtract the average of each data set?
+
+  struct Level {
+    vector<double> aRing;   // the most recent p values (D numbers each)
+    size_t newest;          // the location of the newest value in aRing
+    size_t count;           // the number of values received (in this data set)
+    vector<double> aAccum;  // Σ (values which have not been passed upward yet)
+    size_t num_accum;       // the number of values in aAccum
+    vector<double> aR;      // Σ y_old⋅y_new   (for each bin s)
+    vector<double> aSumOld; // Σ y_old         (for each bin s, D numbers each)
+    vector<double> aSumNew; // Σ y_new         (for each bin s, D numbers each)
+    vector<size_t> aNum;    // the number of products in each bin
+  };
+
+  // The state of the current data set:
+  size_t D;                 // the dimension of each entry
+  size_t N;                 // the number of entries received so far
+  bool series_started;      // was BeginSeries() invoked (without EndSeries())?
+  vector<double> aShift;    // a constant subtracted from every entry (x(0))
+  vector<double> aTotal;    // Σ_i y(i)      (where y(i) = x(i) - shift)
+  vector<double> aY;        // (temporary storage for the value being added)
+  vector<Level> vLevels;
+
+  vector<double> vCcomp;    // the round-off error in vC (before Finalize())
+
+public:
+
+  /// vLag[b] is the separation (j) corresponding to bin b
+  vector<size_t> vLag;
+
+  /// vC[b] stores the correlation function, C(vLag[b])
+  /// (The caller must read in the data and invoke Finalize() beforehand.)
+  vector<double> vC;
+
+  /// vNumSamples[b] is the number of products averaged together in bin b
+  /// (considering all data sets).  (At levels above 0, each product
+  ///  involves averages of m^k entries.)
+  vector<size_t> vNumSamples;
+
+  MultiTauCorrelator(size_t _p = 16, //!< bins per level (a multiple of m)
+                     size_t _m = 2,  //!< averaging factor between levels
+                     size_t _max_lag = 0, //!< the largest separation (0 = no limit)
+                     double _threshold = -1.01, //!< truncate C(j) below threshold*C(0)?
+                     bool _subtract_ave = true //!< compute <(x(i)-<x>)*(x(i+j)-<x>)> ?
+                     ):
+    p(_p),
+    m(_m),
+    max_lag(_max_lag),
+    threshold(_threshold),
+    persistence_length_threshold(_threshold),
+    subtract_ave(_subtract_ave),
+    D(0),
+    N(0),
+    series_started(false)
+  {
+    if ((m < 2) || (p < 2*m) || (p % m != 0))
+      throw InputErr("Error: The multi-tau correlator requires p >= 2*m, and p must be\n"
+                     "       a multiple of m.\n");
+    // (The threshold is handled the same way as in NdAutocrr.)
+    if (max_lag > 0)
+      threshold = -1.01;
+    else if (threshold <= -1.0) {
+      threshold = 1.0 / M_E; //default threshold is 1/e
+      persistence_length_threshold = threshold;
+    }
+
+    // How many levels are needed to reach max_lag?
+    const size_t levels_limit = 64;
+    max_levels = 1;
+    if (max_lag == 0)
+      max_levels = levels_limit;
+    else {
+      size_t spacing = 1;  // m^k
+      while ((p-1) * spacing < max_lag) {
+        spacing *= m;
+        max_levels++;
+      }
+    }
+  }
+
+
+  /// @brief  Begin reading a new data set one entry at a time
+  void
+  BeginSeries(size_t _D) //!< the dimension of each entry
+  {
+    D = _D;
+    N = 0;
+    series_started = true;
+    aShift.assign(D, 0.0);
+    aTotal.assign(D, 0.0);
+    aY.assign(D, 0.0);
+    for (size_t k=0; k < vLevels.size(); k++)
+      ResetLevel(vLevels[k]);
+  }
+
+
+  /// @brief  Was BeginSeries() invoked (and EndSeries() not yet invoked)?
+  bool SeriesStarted() const { return series_started; }
+
+
+  /// @brief  Add the next entry, x(i), to the current data set.
+  void
+  PushFrame(const Scalar *aX_d) //!< x(i), an array of size D
+  {
+    // When subtracting the average, the sums are computed using
+    // y(i) = x(i) - x(0), instead of x(i), to reduce round-off error.
+    if ((N == 0) && subtract_ave)
+      for (size_t d=0; d < D; d++)
+        aShift[d] = aX_d[d];
+    for (size_t d=0; d < D; d++) {
+      aY[d] = aX_d[d] - aShift[d];
+      aTotal[d] += aY[d];
+    }
+    N++;
+
+    // Add y to level 0.  Every m values, pass their average up to the
+    // next level (and so on).
+    for (size_t k=0; k < max_levels; k++) {
+      if (k == vLevels.size())
+        AddLevel();
+      Level &level = vLevels[k];
+      AddValue(k, level, aY.data());
+      for (size_t d=0; d < D; d++)
+        level.aAccum[d] += aY[d];
+      level.num_accum++;
+      if (level.num_accum < m)
+        break;
+      for (size_t d=0; d < D; d++) {
+        aY[d] = level.aAccum[d] / m;
+        level.aAccum[d] = 0.0;
+      }
+      level.num_accum = 0;
+    }
+  } //PushFrame()
+
+
+  /// @brief  Finish processing the current data set (and add its
+  ///         contribution to vC[b] and vNumSamples[b]).
+  void
+  EndSeries()
+  {
+    series_started = false;
+    if (N == 0)
+      return;
+
+    // Let a = ⟨y⟩ (the average of this data set).  Then for each bin:
+    // Σ (y_old-a)⋅(y_new-a) = Σ y_old⋅y_new - a⋅(Σ y_old + Σ y_new) + n a⋅a
+    vector<double> a(D, 0.0);
+    double a_dot_a = 0.0;
+    if (subtract_ave) {
+      for (size_t d=0; d < D; d++) {
+        a[d] = aTotal[d] / N;
+        a_dot_a += a[d]*a[d];
+      }
+    }
+
+    for (size_t k=0; k < vLevels.size(); k++) {
+      Level &level = vLevels[k];
+      for (size_t s=SBegin(k); s < p; s++) {
+        if (level.aNum[s] == 0)
+          continue;
+        double C = level.aR[s];
+        if (subtract_ave) {
+          for (size_t d=0; d < D; d++)
+            C -= a[d] * (level.aSumOld[s*D+d] + level.aSumNew[s*D+d]);
+          C += level.aNum[s] * a_dot_a;
+        }
+        size_t b = Bin(k, s);
+        CompensatedAdd(vC[b], vCcomp[b], C);
+        vNumSamples[b] += level.aNum[s];
+      }
+      ResetLevel(level);
+    }
+    N = 0;
+  } //EndSeries()
+
+
+  /// @brief Invoke this function after reading all the data sets.
+  ///        Divide each bin by the number of samples.  Discard the bins
+  ///        which lack data (or lie beyond the threshold, if one was given).
+  void
+  Finalize()
+  {
+    size_t num_bins = 0;
+    for (size_t b=0; b < vC.size(); b++) {
+      if (vNumSamples[b] == 0)
+        continue;
+      vC[num_bins] = (vC[b] + vCcomp[b]) / vNumSamples[b];
+      vLag[num_bins] = vLag[b];
+      vNumSamples[num_bins] = vNumSamples[b];
+      num_bins++;
+      if ((threshold > -1.0) && (num_bins > 1) &&
+          (vC[num_bins-1] < threshold * vC[0]))
+        break;
+    }
+    vC.resize(num_bins);
+    vCcomp.assign(num_bins, 0.0);
+    vLag.resize(num_bins);
+    vNumSamples.resize(num_bins);
+  } //Finalize()
+
+
+  /// @brief
+  /// Find the separation (j) where C(j)/C(0) drops below "thresh".
+  /// (Use linear interpolation between the neighboring bins.)
+  /// If C(j)/C(0) remains above the threshold for all j values, return -1.0.
+  double
+  ThresholdCrossing(double thresh) const
+  {
+    for (size_t b=1; b < vC.size(); b++) {
+      if (vC[b] < thresh * vC[0]) {
+        double frac = (thresh*vC[0] - vC[b-1]) / (vC[b] - vC[b-1]);
+        return vLag[b-1] + frac * (vLag[b] - vLag[b-1]);
+      }
+    }
+    return -1.0;
+  }
+
+
+  /// @brief  Integrate C(j) (with respect to j), until it drops below the
+  ///         threshold.  Each bin represents the separations between it
+  ///         and the next bin.  Do this after invoking Finalize()
+  double
+  Integrate() const
+  {
+    double integral_of_C = 0.0;
+    for (size_t b=0; b+1 < vC.size(); b++) {
+      if (vC[b] > threshold * vC[0])
+        integral_of_C += vC[b] * (vLag[b+1] - vLag[b]);
+      else
+        break;
+    }
+    return integral_of_C;
+  }
+
+
+  /// @brief  Calculate the correlation length
+  ///         (using the same formulas as NdAutocrr::GuessCorrelationLength(),
+  ///          so that the results from both engines can be compared)
+  double
+  GuessCorrelationLength() const
+  {
+    if (vC.size() == 0)
+      return 0.0;
+    double j_thresh = ThresholdCrossing(persistence_length_threshold);
+    double C_thresh = persistence_length_threshold;
+    if ((j_thresh > 0.0) && (C_thresh > 0.0))
+      return -j_thresh / log(C_thresh);
+    else
+      return Integrate() / vC[0];
+  }
+
+
+private:
+
+  /// @brief  The first bin (s) used at level k.  (At levels above 0, the
+  ///         bins s < p/m are already covered by the level below.)
+  size_t SBegin(size_t k) const { return (k == 0) ? 0 : p/m; }
+
+  /// @brief  The index (in vC) of bin s at level k
+  size_t Bin(size_t k, size_t s) const {
+    if (k == 0)
+      return s;
+    return p + (k-1)*(p - p/m) + (s - p/m);
+  }
+
+  void
+  ResetLevel(Level &level)
+  {
+    level.aRing.assign(p*D, 0.0);
+    level.newest = 0;
+    level.count = 0;
+    level.aAccum.assign(D, 0.0);
+    level.num_accum = 0;
+    level.aR.assign(p, 0.0);
+    level.aSumOld.assign(p*D, 0.0);
+    level.aSumNew.assign(p*D, 0.0);
+    level.aNum.assign(p, 0);
+  }
+
+  /// @brief  Allocate another level (and the corresponding bins)
+  void
+  AddLevel()
+  {
+    size_t k = vLevels.size();
+    vLevels.push_back(Level());
+    ResetLevel(vLevels.back());
+    size_t spacing = 1;  // m^k
+    for (size_t l=0; l < k; l++)
+      spacing *= m;
+    for (size_t s=SBegin(k); s < p; s++) {
+      assert(Bin(k, s) == vLag.size());
+      vLag.push_back(s * spacing);
+      vC.push_back(0.0);
+      vCcomp.push_back(0.0);
+      vNumSamples.push_back(0);
+    }
+  }
+
+  /// @brief  Add a new value to level k, and multiply it with the
+  ///         previous values at this level.
+  void
+  AddValue(size_t k, Level &level, const double *aYnew)
+  {
+    level.newest = (level.newest + p - 1) % p;
+    double *pNew = &level.aRing[level.newest * D];
+    for (size_t d=0; d < D; d++)
+      pNew[d] = aYnew[d];
+    level.count++;
+
+    size_t s_end = (level.count < p) ? level.count : p;
+    size_t s_begin = SBegin(k);
+    for (size_t s=s_begin; s < s_end; s++) {
+      if ((max_lag > 0) && (vLag[Bin(k, s)] > max_lag))
+        break;
+      // the value which arrived s steps earlier
+      const double *pOld = &level.aRing[((level.newest + s) % p) * D];
+      level.aR[s] += inner_product(pOld, pNew, D);
+      for (size_t d=0; d < D; d++) {
+        level.aSumOld[s*D + d] += pOld[d];
+        level.aSumNew[s*D + d] += pNew[d];
+      }
+      level.aNum[s]++;
+    }
+  }
+
+}; //class MultiTauCorrelator
+
+
+
+#endif //#ifndef _MULTITAU_HPP
@@ -6,10 +6,27 @@
 #define _NDAUTOCRR_HPP
 #include <vector>
 #include <cassert>
+#include <algorithm>
+#include <utility>
+#include <sstream>
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
+#include <mutex>
 #define _USE_MATH_DEFINES
 #include <cmath>
-#include "err.h"
+#include "err.hpp"
 #include "inner_product.h"
+#include "dataset.hpp"
+#include "fft.hpp"
+#include "profile.hpp"
+#include "progress.hpp"
+#include "engine_model.hpp"
+#ifndef DISABLE_OPENMP
+#include <omp.h>
+#endif
 using namespace std;
 
 
@@ -22,12 +39,78 @@ template<typename Scalar>
 
 class NdAutocrr {
 
+public:
+
+  /// Which method should we use to compute the correlation function?
+  enum Engine {
+    ENGINE_DIRECT, //!< directly compute Σ_i x(i)*x(i+j) for every j  (O(N*L))
+    ENGINE_FFT,    //!< use the Wiener-Khinchin theorem  (O(N*log(N)))
+    ENGINE_AUTO    //!< choose the faster one for each data set (see SetCostModel())
+  };
+
+private:
+
   bool is_periodic;
   size_t L;
-  Scalar threshold; //used for deciding when to cut the autocorrelation function
-  Scalar persistence_length_threshold; //used for calculating persistence length
+  double threshold; //used for deciding when to cut the autocorrelation function
+  double persistence_length_threshold; //used for calculating persistence length
   bool subtract_ave;
   bool report_rms;
+  Engine engine;
+  bool parallelize_lags; // use multiple threads for each data set?
+  Profiler *pProfiler;   // record the time spent in each step? (optional)
+  ProgressReporter *pProgress; // keep track of the work finished? (optional)
+  EngineCostModel cost_model;  // predicts which engine is faster (ENGINE_AUTO)
+  ostream *pCalibrationLog;    // measure cost_model when needed? (optional)
+  double guessed_cost;         // time predicted so far by the guessed cost_model
+
+  /// Memory which is reused by every data set (to avoid allocating it again).
+  /// (Copies of a ScratchArena start out empty.  See EmptyCopy().)
+  struct ScratchArena {
+    vector<Scalar> aX;  // a data set (in column-major order)
+    ScratchArena() {}
+    ScratchArena(const ScratchArena &) {}
+    ScratchArena &operator=(const ScratchArena &) { return *this; }
+    void Release() { aX = vector<Scalar>(); }
+  };
+  ScratchArena scratch;
+  size_t num_direct_sets;      // the number of data sets using ENGINE_DIRECT
+  size_t num_fft_sets;         // the number of data sets using ENGINE_FFT
+
+  // The following variables are only used by BeginSeries(), PushFrame(),
+  // and EndSeries() (which process the data one entry at a time).
+  size_t stream_D;              // the dimension of each entry
+  size_t stream_N;              // the number of entries received so far
+  bool stream_started;          // was BeginSeries() invoked (without EndSeries())?
+  vector<Scalar> aStreamRing;   // the most recent L+1 entries (stored twice)
+  vector<Scalar> aStreamShift;  // a constant subtracted from every entry
+  vector<double> aStreamTotal;  // Σ_i y(i)      (where y(i) = x(i) - shift)
+  vector<double> aStreamPrefix; // Σ_{i<j} y(i)  (for 0 <= j <= L)
+  vector<double> aStreamR;      // Σ_i y(i)⋅y(i+j)
+  vector<double> aStreamRsq;    // Σ_i (y(i)⋅y(i+j))^2
+  vector<double> aStreamRcomp;  // the round-off error in aStreamR[j]
+  vector<double> aStreamRsqComp;// the round-off error in aStreamRsq[j]
+  vector<double> aStreamBlockR; // Σ_i y(i)⋅y(i+j)     (recent entries only)
+  vector<double> aStreamBlockRsq;//Σ_i (y(i)⋅y(i+j))^2 (recent entries only)
+  static const size_t stream_block_size = 4096; // entries per block
+
+  // The sums in vC[j] and vCrms[j] are accumulated using compensated
+  // summation.  These arrays store the (accumulated) round-off error.
+  vector<double> vCcomp;
+  vector<double> vCrmsComp;
+
+  // Optional: cross-correlations between pairs of columns (a,b)
+  bool cross_all_pairs;               // use every pair of columns?
+  bool per_column;                    // use the pairs (d,d) for every column?
+  vector<pair<size_t, size_t> > vPairs; // the pairs of columns (a,b)
+  vector<vector<double> > vvCpairComp;  // the round-off error in vvCpair
+
+  // Optional: block averaging (to estimate the uncertainty in C(j))
+  bool error_bars;        // keep track of the sums from each block?
+  size_t error_segments;  // the number of blocks per data set
+  bool jackknife;         // use jackknife (rather than block) error estimates?
+  vector<vector<double> > vvCblock;   // vvCblock[b][j] = Σ_i x(i)⋅x(i+j) in block b
+  vector<vector<size_t> > vvNumBlock; // the number of terms in vvCblock[b][j]
 
 public:
 
@@ -46,17 +129,44 @@ public:
   /// (The caller must read in the data beforehand.)
   vector<size_t> vNumSamples; 
 
-  NdAutocrr(Scalar _threshold=-1.01, //!< the value below which vC[j]/vc[0] must fall before it is discarded
+  /// vvCpair[p][j] stores the cross-correlation C_ab(j) = ⟨x_a(i)*x_b(i+j)⟩
+  /// between columns a and b, where (a,b) = CrossPairs()[p].
+  /// (This is only calculated if SetCrossPairs() was invoked.)
+  /// (The caller must read in the data and invoke Finalize() beforehand.)
+  vector<vector<double> > vvCpair;
+
+  /// vCerr[j] estimates the standard error (statistical uncertainty) of vC[j]
+  /// (This is only calculated if SetErrorBlocks() was invoked.)
+  vector<double> vCerr;
+
+  NdAutocrr(double _threshold=-1.01, //!< the value below which vC[j]/vc[0] must fall before it is discarded
             size_t _L=0, //!< _L+1 = the requested size of vC
             bool _is_periodic = false, //!< wrap i+j back into [0,N) when calculating x(i+j)?
             bool _subtract_ave=true, //!< Compute <(x(i)-<x>)*(x(i+j)-<x>)> OR <x(i)*x(i+j)> ?
-            bool _report_rms=false //!< Calculate the rms values of (x(i)-<x>)*(x(i+j)-<x>) ?  (probably not useful)
+            bool _report_rms=false, //!< Calculate the rms values of (x(i)-<x>)*(x(i+j)-<x>) ?  (probably not useful)
+            Engine _engine=ENGINE_DIRECT //!< which method to use when computing C(j)
             ):
     threshold(_threshold),
     L(_L),
     is_periodic(_is_periodic),
     subtract_ave(_subtract_ave),
-    report_rms(_report_rms)
+    report_rms(_report_rms),
+    engine(_engine),
+    parallelize_lags(true),
+    pProfiler(nullptr),
+    pProgress(nullptr),
+    pCalibrationLog(nullptr),
+    guessed_cost(0.0),
+    num_direct_sets(0),
+    num_fft_sets(0),
+    stream_D(0),
+    stream_N(0),
+    stream_started(false),
+    cross_all_pairs(false),
+    per_column(false),
+    error_bars(false),
+    error_segments(1),
+    jackknife(false)
   {
     persistence_length_threshold = threshold;
     if (L > 0) {
@@ -65,8 +175,11 @@ public:
       // (but do use it to calculate the persistence length).
       threshold = -1.01;
       vC.resize(L+1);
-      if (report_rms)
+      vCcomp.resize(L+1);
+      if (report_rms) {
         vCrms.resize(L+1);
+        vCrmsComp.resize(L+1);
+      }
       vNumSamples.resize(L+1);
     }
     else if (threshold <= -1.0) {
@@ -76,6 +189,227 @@ public:
   }
 
 
+  /// @brief  Also calculate the cross-correlations between pairs of columns:
+  ///           C_ab(j) = ⟨x_a(i)*x_b(i+j)⟩
+  ///         (after subtracting the average of each column, if requested).
+  ///         Columns are numbered starting at 0.  If the list of pairs is
+  ///         empty, then all D*D pairs are used (in the order (0,0), (0,1),
+  ///         ..., (D-1,D-1)).  The results are stored in vvCpair.
+  ///         Invoke this before processing the data.
+  void SetCrossPairs(const vector<pair<size_t, size_t> > &_vPairs)
+  {
+    vPairs = _vPairs;
+    cross_all_pairs = vPairs.empty();
+    per_column = false;
+    vvCpair.assign(vPairs.size(), vector<double>(vC.size(), 0.0));
+    vvCpairComp = vvCpair;
+  }
+
+
+  /// @brief  Calculate a separate autocorrelation function for each column:
+  ///           C_d(j) = ⟨x_d(i)*x_d(i+j)⟩
+  ///         (after subtracting the average of each column, if requested).
+  ///         The results are stored in vvCpair[d].  (This is equivalent to
+  ///         invoking SetCrossPairs() with the pairs (0,0), (1,1), ...)
+  ///         Invoke this before processing the data.
+  void SetPerColumn()
+  {
+    vPairs.clear();
+    vvCpair.clear();
+    vvCpairComp.clear();
+    cross_all_pairs = false;
+    per_column = true;
+  }
+
+
+  /// @brief  Estimate the standard error of C(j) (stored in vCerr[j])
+  ///         by dividing the data into blocks and comparing the C(j)
+  ///         estimated from each block.  Each data set is divided into
+  ///         "num_segments" blocks of (nearly) equal length.  The product
+  ///         x(i)⋅x(i+j) belongs to the block containing x(i).
+  ///         (So the sums from all of the blocks add up to the usual sums,
+  ///          and only the sums from each block need to be stored.)
+  ///         If use_jackknife==true, then the errors are estimated by
+  ///         omitting one block at a time (jackknife resampling).
+  ///         Otherwise, the blocks are treated as independent measurements.
+  ///         (Using num_segments > 1 requires the direct engine, and
+  ///          does not support BeginSeries().)
+  ///         Invoke this before processing the data.
+  void SetErrorBlocks(size_t num_segments = 1, bool use_jackknife = false)
+  {
+    // (Check this now, rather than while the data sets are being processed
+    //  by multiple threads, where an exception could not be caught.)
+    if ((num_segments > 1) && (engine == ENGINE_FFT))
+      throw InputErr("Error: Dividing data sets into blocks (\"-err B\") is not supported\n"
+                     "       by the FFT method.\n");
+    error_bars = true;
+    error_segments = (num_segments > 0) ? num_segments : 1;
+    jackknife = use_jackknife;
+  }
+
+
+  /// @brief  Record the time spent copying the data and computing the sums
+  ///         (by each thread) in *_pProfiler.  (nullptr disables this.)
+  ///         Invoke this before processing the data.
+  void SetProfiler(Profiler *_pProfiler) { pProfiler = _pProfiler; }
+
+
+  /// @brief  Keep track of the amount of work requested (and finished)
+  ///         using *_pProgress.  (nullptr disables this.)
+  ///         Invoke this before processing the data.
+  void SetProgress(ProgressReporter *_pProgress) { pProgress = _pProgress; }
+
+
+  /// @brief  Use these parameters to predict which engine is faster
+  ///         (when ENGINE_AUTO is used).  (See CalibrateEngines().)
+  ///         If they are only guesses (_cost_model.source is empty) and
+  ///         _pCalibrationLog is not nullptr, then they will be measured
+  ///         (see LoadCostModel()) once the amount of computation is large
+  ///         enough for the choice to matter.  (See PrepareCostModel().)
+  ///         Invoke this before processing the data.
+  void SetCostModel(const EngineCostModel &_cost_model,
+                    ostream *_pCalibrationLog = nullptr) //!< (print messages here)
+  {
+    cost_model = _cost_model;
+    pCalibrationLog = _pCalibrationLog;
+    guessed_cost = 0.0;
+  }
+
+
+  /// @brief  Return the number of data sets processed so far using
+  ///         a given engine (ENGINE_DIRECT or ENGINE_FFT).
+  ///         (When a threshold is used, the FFT may be used for only some
+  ///          of the lags.  Those data sets are counted as ENGINE_FFT.)
+  size_t NumDataSets(Engine e) const {
+    return (e == ENGINE_FFT) ? num_fft_sets : num_direct_sets;
+  }
+
+
+  /// @brief  Measure the speed of each engine on this computer (using a
+  ///         single thread, and synthetic data stored using the Scalar
+  ///         type) and return the corresponding cost model.  This takes a
+  ///         fraction of a second, so the result should be saved (see
+  ///         EngineCostModel::Save()).
+  static EngineCostModel CalibrateEngines()
+  {
+    const size_t N = (1 << 16);  // (the data set used by the direct engine)
+    const size_t D = 3;
+    const size_t jmax = 511;
+    const int num_trials = 2;    // (the fastest trial is used)
+
+    // (random walks, generated the same way every time)
+    uint64_t seed = 12345;
+    auto random_walk = [&](size_t N, size_t D) {
+      vector<vector<Scalar> > vvX_id(N, vector<Scalar>(D, 0.0));
+      for (size_t i=1; i < N; i++) {
+        for (size_t d=0; d < D; d++) {
+          seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+          double r = static_cast<double>(seed >> 11) / 9007199254740992.0 - 0.5;
+          vvX_id[i][d] = static_cast<Scalar>(vvX_id[i-1][d] + r);
+        }
+      }
+      return DataSet<Scalar>(vvX_id);
+    };
+
+    auto measure = [&](const DataSet<Scalar> &X_id, Engine e, bool rms) {
+      double t_best = -1.0;
+      for (int trial=0; trial < num_trials; trial++) {
+        NdAutocrr calib(-1.01, min(jmax, X_id.size()-1), false, true, rms, e);
+        calib.parallelize_lags = false;
+        double t_begin = Profiler::Now();
+        calib.AccumulateSingle(X_id);
+        double t = Profiler::Now() - t_begin;
+        if ((t_best < 0.0) || (t < t_best))
+          t_best = t;
+      }
+      return (t_best > 0.0) ? t_best : 1.0e-9;
+    };
+
+    // (The FFT engine is measured using a small and a large transform.)
+    auto fft_point = [&](size_t log2_M) {
+      size_t N_fft = (size_t(1) << log2_M) / 2;  // (so that NextPow2(2N) = M)
+      DataSet<Scalar> X_id = random_walk(N_fft, 1);
+      return (measure(X_id, ENGINE_FFT, false) /
+              (EngineCostModel::AutoTransforms(1) * N_fft * 2.0 * log2_M));
+    };
+
+    DataSet<Scalar> X_id = random_walk(N, D);
+    NdAutocrr counter(-1.01, jmax);  // (used to count the products)
+    double num_products = counter.NumProducts(N, D, 0, jmax+1);
+    EngineCostModel model;
+    model.direct_product = measure(X_id, ENGINE_DIRECT, false) / num_products;
+    model.direct_product_rms = measure(X_id, ENGINE_DIRECT, true) / num_products;
+    model.fft_point_small = fft_point(EngineCostModel::log2_M_small);
+    model.fft_point_large = fft_point(EngineCostModel::log2_M_large);
+    model.source = "measured";
+    return model;
+  } //CalibrateEngines()
+
+
+  /// @brief  Read the cost model (for this Scalar type) from the file
+  ///         EngineCostModel::CacheFilename() (if it is there).
+  ///         Returns false (and leaves "model" unchanged) otherwise.
+  static bool ReadCostModel(EngineCostModel &model)
+  {
+    string cache_filename = EngineCostModel::CacheFilename();
+    return ((! cache_filename.empty()) &&
+            model.Load(cache_filename, EngineCostModel::Key(sizeof(Scalar))));
+  }
+
+
+  /// @brief  Read the cost model (for this Scalar type) from the file
+  ///         EngineCostModel::CacheFilename().  If it is not there yet,
+  ///         measure it (see CalibrateEngines()) and save it there.
+  ///         (It is only measured once by each process, even if it can not
+  ///          be saved, and even if this is invoked by several threads.)
+  ///         (Messages are printed to "log".)
+  static EngineCostModel LoadCostModel(ostream &log)
+  {
+    static mutex model_mutex;
+    static EngineCostModel model;  // (source is empty until it is known)
+    lock_guard<mutex> lock(model_mutex);
+    if (! model.source.empty())
+      return model;
+    if (ReadCostModel(model)) {
+      log << "# engine: using the cost model in \"" << model.source << "\"\n";
+      return model;
+    }
+    log << "# engine: measuring the speed of each engine (only done once)" << endl;
+    model = CalibrateEngines();
+    string key = EngineCostModel::Key(sizeof(Scalar));
+    string cache_filename = EngineCostModel::CacheFilename();
+    if ((! cache_filename.empty()) && model.Save(cache_filename, key)) {
+      model.source = cache_filename;
+      log << "# engine: saved the cost model in \"" << cache_filename << "\"\n";
+    }
+    else
+      log << "# engine: (unable to save the cost model)\n";
+    return model;
+  } //LoadCostModel()
+
+
+  /// @brief  Return the number of blocks used to estimate the errors
+  size_t NumErrorBlocks() const { return vvCblock.size(); }
+
+
+  /// @brief  Return the pairs of columns used by vvCpair
+  ///         (which is not known until the first data set was read,
+  ///          if all pairs were requested).
+  const vector<pair<size_t, size_t> > &CrossPairs() const { return vPairs; }
+
+
+  /// @brief  Will the cross-correlations (vvCpair) be calculated?
+  bool UsesCrossPairs() const {
+    return cross_all_pairs || per_column || (! vPairs.empty());
+  }
+
+
+  /// @brief  Will C(j) be truncated when it decays below the threshold?
+  ///         (In that case, all of the data sets should be passed to
+  ///          Accumulate() together.)
+  bool UsesThreshold() const { return threshold > -1.0; }
+
+
   /// @brief  Return the size of the vC[j] array (or at least the portion
   ///         of which we care about).
   size_t size() const { assert(L+1 == vC.size()); return L; }
@@ -83,149 +417,681 @@ public:
 
   /// @brief  Accumulate the sums used to calculate the average (vC[j])
   size_t
-  Accumulate(const vector<vector<vector<Scalar> > > &vvvX_nid, //!< series of data points (each is a vector of dimension d)
-             ostream *pReportProgress = nullptr)  //!< print progress to the user?
+  Accumulate(const vector<DataSet<Scalar> > &vX_n) //!< a list of data sets
+  {
+    vector<DataView<Scalar> > vViews(vX_n.size());
+    for (size_t n=0; n < vX_n.size(); n++)
+      vViews[n] = vX_n[n].view();
+    return Accumulate(vViews);
+  }
+
+
+  /// @brief  Accumulate the sums used to calculate the average (vC[j])
+  ///         from many data sets.  When there are many (small) data sets,
+  ///         different data sets are processed simultaneously by different
+  ///         threads.  The data sets are divided into groups ("chunks") of
+  ///         consecutive data sets, which are processed independently
+  ///         (using separate copies of vC, vCrms, and vNumSamples), and then
+  ///         added together in order.  The way the data sets are divided
+  ///         does not depend on the number of threads, so the results are
+  ///         identical (bit for bit) regardless of the number of threads.
+  /// @overloaded
+  template<typename T>
+  size_t
+  Accumulate(const vector<DataView<T> > &vX_n) //!< a list of data sets
+  {
+    if (threshold > -1.0)
+      return AccumulateThreshold(vX_n);
+    return AccumulateMany(vX_n,
+                          [&](NdAutocrr &target, size_t n) {
+                            target.AccumulateDataSet(vX_n[n]);
+                          });
+  }
+
+
+  /// @brief  Accumulate the sums used to calculate the average (vC[j])
+  ///         from many data sets which are no longer needed by the caller.
+  ///         The memory occupied by each data set is reused (the data is
+  ///         rearranged in place) rather than copied, and it is freed once
+  ///         that data set has been processed.  (Afterwards, the data sets
+  ///         in vX_n are empty.)  The results are identical to the other
+  ///         version of Accumulate().
+  /// @overloaded
+  size_t
+  Accumulate(vector<DataSet<Scalar> > &&vX_n) //!< a list of data sets
+  {
+    if (threshold > -1.0)
+      return AccumulateThreshold(std::move(vX_n));
+    vector<DataView<Scalar> > vViews(vX_n.size());
+    for (size_t n=0; n < vX_n.size(); n++)
+      vViews[n] = vX_n[n].view();
+    return AccumulateMany(vViews,
+                          [&](NdAutocrr &target, size_t n) {
+                            target.AccumulateDataSet(std::move(vX_n[n]));
+                          });
+  }
+
+
+  /// @brief  Accumulate the sums used to calculate the average (vC[j])
+  /// @overloaded
+  size_t
+  Accumulate(const vector<vector<vector<Scalar> > > &vvvX_nid) //!< series of data points (each is a vector of dimension d)
   {
     for (int n=0; n < vvvX_nid.size(); n++)
-      AccumulateSingle(vvvX_nid[n], pReportProgress);
+      AccumulateSingle(vvvX_nid[n]);
     return L;
   }
 
 
   /// @brief Accumulate the sums used to calculate the average (vC[j])
   ///        considering only data from a single data set.
+  /// @overloaded
   size_t
-  AccumulateSingle(const vector<vector<Scalar> > &vvX_id, //!< series of data points (each is a vector of dimension d)
-                   ostream *pReportProgress = nullptr)  //!< print progress to the user?
+  AccumulateSingle(const vector<vector<Scalar> > &vvX_id) //!< series of data points (each is a vector of dimension d)
   {
-    vector<vector<Scalar> > _vvX_id = vvX_id; //make a local copy of the data set
-    size_t L_single = _vvX_id.size();
-    ChooseL(L_single);
+    // (The temporary DataSet is rearranged in place, rather than copied.)
+    return AccumulateSingle(DataSet<Scalar>(vvX_id));
+  }
 
-    vector<Scalar> x_ave;
 
-    int D = 0;
-    for (size_t i=0; i < _vvX_id.size(); i++) {
-      if (i == 0) 
-        D = _vvX_id[i].size();
-      else if (D != _vvX_id[i].size())
-        throw InputErr("Error: Inconsistent number of entries on each line.\n");
+  /// @brief Accumulate the sums used to calculate the average (vC[j])
+  ///        considering only data from a single data set.
+  /// @overloaded
+  size_t
+  AccumulateSingle(const DataSet<Scalar> &X_id) //!< series of data points (each is a vector of dimension d)
+  {
+    return AccumulateSingle(X_id.view());
+  }
+
+
+  /// @brief Accumulate the sums used to calculate the average (vC[j])
+  ///        considering only data from a single data set, which is no
+  ///        longer needed by the caller.  Its memory is reused (the data
+  ///        is rearranged in place) rather than copied.  (Afterwards,
+  ///        X_id is empty.)
+  /// @overloaded
+  size_t
+  AccumulateSingle(DataSet<Scalar> &&X_id) //!< series of data points (each is a vector of dimension d)
+  {
+    if (threshold > -1.0) {
+      vector<DataSet<Scalar> > vX_n(1);
+      vX_n[0] = std::move(X_id);
+      return AccumulateThreshold(std::move(vX_n));
     }
+    PrepareCostModel(vector<DataView<Scalar> >(1, X_id.view()));
+    if (pProgress)
+      pProgress->AddWork(DataSetWork(X_id.view()));
+    return AccumulateDataSet(std::move(X_id));
+  }
 
 
-    // Should we subtract the average value when calculating autocorrelation?
-    if (subtract_ave) {
+  /// @brief Accumulate the sums used to calculate the average (vC[j])
+  ///        considering only data from a single data set, stored elsewhere
+  ///        in memory:  x_d(i) = aX_id[i*row_stride + d]
+  ///        (The data is not modified, and it need not be of type Scalar.)
+  /// @overloaded
+  template<typename T>
+  size_t
+  AccumulateSingle(const T *aX_id,  //!< the data
+                   size_t N,        //!< the number of entries (rows)
+                   size_t D,        //!< the number of components (columns)
+                   size_t row_stride = 0) //!< distance between rows (0 means D)
+  {
+    return AccumulateSingle(DataView<T>(aX_id, N, D, row_stride));
+  }
 
-      // If so, then ...
-      x_ave.resize(D, 0.0);
-      for (size_t i=0; i < _vvX_id.size(); i++)
-        for (size_t d=0; d < D; d++)
-          x_ave[d] += _vvX_id[i][d];
-      for (size_t d=0; d < D; d++)
-        x_ave[d] /= _vvX_id.size();
 
-      // subtract the average value
-      for (size_t i=0; i < _vvX_id.size(); ++i)
-        for (size_t d=0; d < D; d++)
-        _vvX_id[i][d] -= x_ave[d];
+  /// @brief Accumulate the sums used to calculate the average (vC[j])
+  ///        considering only data from a single data set.
+  ///        The data is not modified (and it need not be of type Scalar).
+  template<typename T>
+  size_t
+  AccumulateSingle(const DataView<T> &X_id) //!< series of data points (each is a vector of dimension d)
+  {
+    if (threshold > -1.0) {
+      // C(j) will be truncated when it decays below the threshold
+      vector<DataView<T> > vX_n(1, X_id);
+      return AccumulateThreshold(vX_n);
     }
+    PrepareCostModel(vector<DataView<T> >(1, X_id));
+    if (pProgress)
+      pProgress->AddWork(DataSetWork(X_id));
+    return AccumulateDataSet(X_id);
+  }
 
 
-    if (is_periodic)
-    {
+private:
 
-      size_t jmax = _vvX_id.size();
-      if (jmax > L)
-        jmax = L;
+  /// @brief  The calculation performed by Accumulate() (when no threshold
+  ///         is used).  process(target, n) adds the sums from data set n
+  ///         to "target" (see AccumulateDataSet()).
+  template<typename T, typename ProcessDataSet>
+  size_t
+  AccumulateMany(const vector<DataView<T> > &vX_n, //!< a list of data sets
+                 ProcessDataSet process)
+  {
+    if (vX_n.size() > 0)
+      ChoosePairs(vX_n[0].dim()); //(so that every chunk uses the same pairs)
+    PrepareCostModel(vX_n);
+
+    if (pProgress)
+      for (size_t n=0; n < vX_n.size(); n++)
+        pProgress->AddWork(DataSetWork(vX_n[n]));
+
+    vector<size_t> vChunkBegin;
+    ChunkDataSets(vX_n, vChunkBegin);
+    size_t num_chunks = vChunkBegin.size() - 1;
+
+    if (num_chunks <= 1) {
+      // Process the data sets one at a time (using multiple threads for each)
+      for (size_t n=0; n < vX_n.size(); n++)
+        process(*this, n);
+      return L;
+    }
 
-      #pragma omp parallel
-      {
-        #pragma omp for collapse(1)
-        for (size_t j=0; j <= jmax; ++j)
-        {
-          if (j > jmax)
-            continue;
-          if (pReportProgress)
-            *pReportProgress << "#    processing separation " << j << endl;
-          for (size_t i=0; i < _vvX_id.size(); ++i)
-          {
-            size_t iplusj = i+j;
-            if (iplusj >= _vvX_id.size()) 
-              iplusj -= _vvX_id.size();
-            assert((0 <= iplusj) && (iplusj < _vvX_id.size()));
-
-            Scalar C = inner_product(_vvX_id[i], _vvX_id[iplusj]);
-            vC[j] += C;
-
-            if (report_rms)
-              vCrms[j] += C*C;
-          }
+    vector<NdAutocrr> vPartial(num_chunks, EmptyCopy());
+
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (size_t c=0; c < num_chunks; c++) {
+      for (size_t n=vChunkBegin[c]; n < vChunkBegin[c+1]; n++)
+        process(vPartial[c], n);
+      vPartial[c].scratch.Release();  // (this memory is not needed anymore)
+    }
+
+    for (size_t c=0; c < num_chunks; c++)
+      Merge(vPartial[c]);
+
+    return L;
+  } //AccumulateMany()
+
+
+  /// @brief  The calculation performed by AccumulateSingle()
+  ///         (when no threshold is used).
+  template<typename T>
+  size_t
+  AccumulateDataSet(const DataView<T> &X_id)
+  {
+    return AccumulateDataSet(X_id.size(), X_id.dim(),
+                             [&](size_t ld, vector<Scalar> &aX) {
+                               CopyColumns(X_id, ld, aX);
+                             });
+  }
 
-          vNumSamples[j] += _vvX_id.size();
-
-          // Check for threshold violations.
-          // If the covariance function is too low, then quit
-          if (vC[j] < threshold * vC[0])
-          {
-            #pragma omp critical
-            {
-              if (j < jmax) {
-                L = j;       //This will truncate the correlation function.
-                jmax=j;      //This will break us out of the loop.
-              }
-            }
-          }
-        } //for (size_t j=0; j <= jmax; ++j)
-      } //#pragma omp parallel
 
-    } //if (is_periodic)
+  /// @brief  The calculation performed by AccumulateSingle()
+  ///         (when no threshold is used) for a data set which can be
+  ///         rearranged in place (see TakeColumns()).
+  size_t
+  AccumulateDataSet(DataSet<Scalar> &&X_id)
+  {
+    return AccumulateDataSet(X_id.size(), X_id.dim(),
+                             [&](size_t ld, vector<Scalar> &aX) {
+                               TakeColumns(X_id, ld, aX);
+                             });
+  }
+
+
+  /// @brief  The calculation performed by AccumulateSingle() (when no
+  ///         threshold is used) for a data set with N entries and D columns.
+  ///         get_columns(ld, aX) stores the data set in aX (see CopyColumns()).
+  template<typename GetColumns>
+  size_t
+  AccumulateDataSet(size_t N, size_t D, GetColumns get_columns)
+  {
+    ChooseL(N);
+    ChoosePairs(D);
+
+    size_t jmax = N;
+    if (jmax > L)
+      jmax = L;
+
+    // Store the data set in column-major order, after subtracting the
+    // average value (if requested), in memory which is reused for every
+    // data set (the scratch arena), or else in the data set's own memory.
+    // In the periodic case, a copy of the first jmax entries is appended to
+    // the end of each column, so that x((i+j)%N) is located at x(i+j).
+    size_t ld = N;  // the length of each column
+    if (is_periodic)
+      ld += jmax;
+    vector<Scalar> &aX = scratch.aX;
+    get_columns(ld, aX);
+
+    // (When estimating errors, this data set contributes num_seg blocks.)
+    size_t num_seg = error_bars ? error_segments : 0;
+    size_t b0 = NewErrorBlocks(num_seg);
+    assert((num_seg <= 1) || (engine != ENGINE_FFT)); // (see SetErrorBlocks())
+
+    if (per_column && (! report_rms) && (num_seg <= 1)) {
+      // C(j) is the sum of the autocorrelations of each column,
+      // so there is no need to compute it separately.
+      CountDataSet(ChoosePairEngine(N, D, jmax));
+      vector<double> aTrace(jmax+1, 0.0);
+      AccumulatePairs(aX, N, ld, D, jmax, &aTrace);
+      for (size_t j=0; j <= jmax; ++j) {
+        AddSums(j, aTrace[j], 0.0, is_periodic ? N : N-j);
+        if (num_seg > 0)
+          AddBlockSums(b0, j, aTrace[j], is_periodic ? N : N-j);
+      }
+      if (pProgress)
+        pProgress->AddDone(NumProducts(N, D, 0, jmax+1));
+      return L;
+    }
+
+    Engine set_engine = ChooseEngine(N, D, jmax, num_seg);
+    CountDataSet(set_engine);
+
+    if (set_engine == ENGINE_FFT)
+    {
+      vector<double> aC(jmax+1, 0.0), aCsq(report_rms ? jmax+1 : 0, 0.0);
+      vector<size_t> aNumSamples(jmax+1, 0);
+      AccumulateFFT(aX, N, ld, D, jmax, aC, aCsq, aNumSamples);
+      for (size_t j=0; j <= jmax; ++j) {
+        AddSums(j, aC[j], (report_rms ? aCsq[j] : 0.0), aNumSamples[j]);
+        if (num_seg > 0)
+          AddBlockSums(b0, j, aC[j], aNumSamples[j]);
+      }
+      if (pProgress)
+        pProgress->AddDone(NumProducts(N, D, 0, jmax+1));
+    }
     else
     {
+      // Choose the kernel which computes Σ_i x(i)⋅x(i+j) once per data set.
+      typename LagSumKernel<Scalar>::type lag_sum =
+        ChooseLagSumKernel<Scalar>(D, report_rms);
+
+      // The (i,j) triangle is divided into tasks requiring a similar amount
+      // of work (see PartitionLags()).  Each task is processed by a single
+      // thread, one cache-sized tile of i values at a time.  The sums from
+      // each task are stored separately, and added together (in order)
+      // afterwards.
+      LagTile tile = ChooseLagTile(N, D, sizeof(Scalar));
+      vector<LagTask> vTasks;
+      PartitionLags(N, D, jmax, num_seg, tile, vTasks);
+      size_t num_tasks = vTasks.size();
+      vector<size_t> vOffset(num_tasks+1, 0); // where the sums are stored
+      for (size_t t=0; t < num_tasks; ++t)
+        vOffset[t+1] = vOffset[t] + (vTasks[t].j_end - vTasks[t].j_begin);
+      vector<double> aTaskC(vOffset[num_tasks], 0.0);
+      vector<double> aTaskCsq(vOffset[num_tasks], 0.0);
+
+      // Start the most expensive tasks first (so that the threads finish
+      // at nearly the same time).
+      vector<pair<double, size_t> > vOrder(num_tasks);
+      for (size_t t=0; t < num_tasks; ++t) {
+        const LagTask &task = vTasks[t];
+        double num_products = 0.0;
+        for (size_t j=task.j_begin; j < task.j_end; ++j)
+          num_products += NumTerms(N, j, task.i_first, task.i_last);
+        vOrder[t] = make_pair(-num_products * D, t);
+      }
+      sort(vOrder.begin(), vOrder.end());
 
-      size_t jmax = _vvX_id.size();
-      if (jmax > L)
-        jmax = L;
-
-      #pragma omp parallel
+      #pragma omp parallel for schedule(dynamic) if (parallelize_lags)
+      for (size_t k=0; k < num_tasks; ++k)
       {
-        #pragma omp for collapse(1)
-        for (size_t j=0; j <= jmax; ++j)
-        {
-          if (j > jmax)
-            continue;
-          if (pReportProgress)
-            *pReportProgress << "#    processing separation " << j << endl;
-          for (size_t i=0; i < _vvX_id.size()-j; ++i)
-          {
-            Scalar C = inner_product(_vvX_id[i], _vvX_id[i+j]);
-            vC[j] += C;
-
-            if (report_rms)
-              vCrms[j] += C*C;
-          }
+        size_t t = vOrder[k].second;
+        const LagTask &task = vTasks[t];
+        double t_begin = pProfiler ? Profiler::Now() : 0.0;
+
+        LagBlockSum<Scalar>(lag_sum, aX.data(), ld, D, N, is_periodic,
+                            task.j_begin, task.j_end, tile.i,
+                            &aTaskC[vOffset[t]], &aTaskCsq[vOffset[t]],
+                            task.i_first, task.i_last);
+
+        if (pProfiler)
+          pProfiler->AddKernelTime(Profiler::Now() - t_begin,
+                                   -vOrder[k].first);
+        if (pProgress)
+          pProgress->AddDone(-vOrder[k].first);
+      } //for (size_t k=0; k < num_tasks; ++k)
+
+      for (size_t t=0; t < num_tasks; ++t) {
+        const LagTask &task = vTasks[t];
+        for (size_t j=task.j_begin; j < task.j_end; ++j) {
+          size_t num_i = NumTerms(N, j, task.i_first, task.i_last);
+          if (num_i == 0)
+            break;   // (num_i decreases with j)
+          size_t k = vOffset[t] + (j - task.j_begin);
+          AddSums(j, aTaskC[k], aTaskCsq[k], num_i);
+          if (num_seg > 0)
+            AddBlockSums(b0 + task.seg, j, aTaskC[k], num_i);
+        }
+      }
 
-          vNumSamples[j] += _vvX_id.size()-j;
-
-          // Check for threshold violations.
-          // If the covariance function is too low, then quit
-          if (vC[j] < threshold * vC[0]) {
-            #pragma omp critical
-            {
-              if (j < jmax) {
-                L = j;       //This will truncate the correlation function.
-                jmax=j;      //This will break us out of the loop.
-              }
-            }
-          }
-        } //for (size_t j=0; j <= jmax; ++j)
-      } //#pragma omp parallel
+    } //else clause for "if (set_engine == ENGINE_FFT)"
 
-    } //else clause for "if (is_periodic)"
+    AccumulatePairs(aX, N, ld, D, jmax);
 
-    if (vC.size() <= L) // if we reduced L, truncate the correlation function
-      vC.resize(L+1);
     return L;
-  } //size_t AccumulateSingle()
+  } //size_t AccumulateDataSet()
+
+
+public:
+
+
+
+  /// @brief  Add the (un-normalized) sums from another NdAutocrr object
+  ///         to this one.  (Both objects should use the same settings.)
+  ///         This must be done before invoking Finalize().
+  void
+  Merge(const NdAutocrr &other)
+  {
+    if (other.L > L)
+      Resize(other.L);
+    num_direct_sets += other.num_direct_sets;
+    num_fft_sets += other.num_fft_sets;
+    for (size_t j=0; j < other.vC.size(); ++j) {
+      double C = other.vC[j];
+      if (j < other.vCcomp.size())
+        C += other.vCcomp[j];
+      double Csq = 0.0;
+      if (report_rms && (j < other.vCrms.size())) {
+        Csq = other.vCrms[j];
+        if (j < other.vCrmsComp.size())
+          Csq += other.vCrmsComp[j];
+      }
+      AddSums(j, C, Csq, other.vNumSamples[j]);
+    }
+    if (vPairs.empty() && (! other.vPairs.empty())) {
+      vPairs = other.vPairs;
+      vvCpair.assign(vPairs.size(), vector<double>(vC.size(), 0.0));
+      vvCpairComp = vvCpair;
+    }
+    assert(other.vvCpair.size() == vvCpair.size());
+    for (size_t p=0; p < other.vvCpair.size(); ++p)
+      for (size_t j=0; j < other.vvCpair[p].size(); ++j)
+        CompensatedAdd(vvCpair[p][j], vvCpairComp[p][j],
+                       other.vvCpair[p][j] + other.vvCpairComp[p][j]);
+    // (The blocks from the other object are appended to the list of blocks.)
+    for (size_t b=0; b < other.vvCblock.size(); ++b) {
+      vvCblock.push_back(other.vvCblock[b]);
+      vvNumBlock.push_back(other.vvNumBlock[b]);
+      vvCblock.back().resize(L+1, 0.0);
+      vvNumBlock.back().resize(L+1, 0);
+    }
+  }
+
+
+  /// @brief  Write the (un-normalized) sums accumulated so far, along with
+  ///         the settings they depend on, to a binary file.  The file can be
+  ///         read later using Load(), and added to the sums from other data
+  ///         (for example, from other processes, or when resuming a long
+  ///         calculation).  This must be done before invoking Finalize().
+  ///         (The numbers are stored using this computer's byte order.)
+  void
+  Save(ostream &out) const
+  {
+    if (threshold > -1.0)
+      throw InputErr("Error: Saving the sums requires that L is specified in advance\n"
+                     "       (using \"-L\"), so that they can be combined with other sums.\n");
+    if (stream_started)
+      throw InputErr("Error: Unable to save the sums while a data set is being streamed.\n");
+    out.write(state_magic, sizeof(state_magic));
+    WriteInt(out, state_byte_order);
+    WriteInt(out, state_version);
+    WriteInt(out, L);
+    WriteInt(out, StateFlags());
+    WriteInt(out, error_segments);
+    WriteArray(out, vC);
+    WriteArray(out, vCcomp);
+    WriteArray(out, vCrms);
+    WriteArray(out, vCrmsComp);
+    WriteArray(out, vNumSamples);
+    WriteInt(out, vPairs.size());
+    for (size_t p=0; p < vPairs.size(); p++) {
+      WriteInt(out, vPairs[p].first);
+      WriteInt(out, vPairs[p].second);
+      WriteArray(out, vvCpair[p]);
+      WriteArray(out, vvCpairComp[p]);
+    }
+    WriteInt(out, vvCblock.size());
+    for (size_t b=0; b < vvCblock.size(); b++) {
+      WriteArray(out, vvCblock[b]);
+      WriteArray(out, vvNumBlock[b]);
+    }
+    if (! out)
+      throw InputErr("Error: Unable to write the sums to a file.\n");
+  } //Save()
+
+
+  /// @brief  Read the sums from a file created by Save(), and add them to
+  ///         the sums stored in this object (as in Merge()).  The settings
+  ///         used to create the file must agree with the settings of this
+  ///         object.  This must be done before invoking Finalize().
+  void
+  Load(istream &in,
+       const string &filename) //!< (for error messages)
+  {
+    if (threshold > -1.0)
+      throw InputErr("Error: Loading saved sums requires that L is specified in advance\n"
+                     "       (using \"-L\").\n");
+    string err_prefix = "Error in file \"" + filename + "\":\n       ";
+    char magic[sizeof(state_magic)];
+    in.read(magic, sizeof(magic));
+    if ((! in) || (memcmp(magic, state_magic, sizeof(magic)) != 0))
+      throw InputErr(err_prefix + "This is not a file created by \"-save\".\n");
+    if (ReadInt(in, err_prefix) != state_byte_order)
+      throw InputErr(err_prefix + "The file was created on a computer with a different byte order.\n");
+    if (ReadInt(in, err_prefix) != state_version)
+      throw InputErr(err_prefix + "The file was created by an incompatible version of this program.\n");
+
+    NdAutocrr other(EmptyCopy());
+    other.L = ReadInt(in, err_prefix);
+    uint64_t flags = ReadInt(in, err_prefix);
+    size_t segments = ReadInt(in, err_prefix);
+    if (flags != StateFlags())
+      throw InputErr(err_prefix + "The file was created using different settings.\n"
+                     "       (Check the -p, -ave, -avezero, -rms, -cross, -pair, -percolumn,\n"
+                     "        -err, and -jackknife arguments.)\n");
+    if (error_bars && (segments != error_segments))
+      throw InputErr(err_prefix + "The file was created using a different number of blocks (-err).\n");
+    if (other.L != L) {
+      // (Otherwise the lags beyond the smaller L would be missing the data
+      //  from one of the files, or they would be omitted.)
+      stringstream err_msg;
+      err_msg << err_prefix << "The file was created using a different -L argument\n"
+              << "       (L = " << other.L << ", not " << L << ").\n";
+      throw InputErr(err_msg.str());
+    }
+    ReadArray(in, other.vC, err_prefix);
+    ReadArray(in, other.vCcomp, err_prefix);
+    ReadArray(in, other.vCrms, err_prefix);
+    ReadArray(in, other.vCrmsComp, err_prefix);
+    ReadArray(in, other.vNumSamples, err_prefix);
+    size_t num_pairs = ReadInt(in, err_prefix);
+    other.vPairs.resize(num_pairs);
+    other.vvCpair.resize(num_pairs);
+    other.vvCpairComp.resize(num_pairs);
+    for (size_t p=0; p < num_pairs; p++) {
+      other.vPairs[p].first = ReadInt(in, err_prefix);
+      other.vPairs[p].second = ReadInt(in, err_prefix);
+      ReadArray(in, other.vvCpair[p], err_prefix);
+      ReadArray(in, other.vvCpairComp[p], err_prefix);
+    }
+    size_t num_blocks = ReadInt(in, err_prefix);
+    other.vvCblock.resize(num_blocks);
+    other.vvNumBlock.resize(num_blocks);
+    for (size_t b=0; b < num_blocks; b++) {
+      ReadArray(in, other.vvCblock[b], err_prefix);
+      ReadArray(in, other.vvNumBlock[b], err_prefix);
+    }
+
+    // Check that the arrays are consistent with each other
+    bool ok = ((other.vC.size() == other.L+1) &&
+               (other.vCcomp.size() == other.L+1) &&
+               (other.vNumSamples.size() == other.L+1) &&
+               (other.vCrms.size() == (report_rms ? other.L+1 : other.vCrms.size())) &&
+               (other.vCrmsComp.size() == other.vCrms.size()));
+    for (size_t p=0; p < num_pairs; p++)
+      ok = ok && (other.vvCpair[p].size() == other.L+1) &&
+                 (other.vvCpairComp[p].size() == other.L+1);
+    for (size_t b=0; b < num_blocks; b++)
+      ok = ok && (other.vvCblock[b].size() == other.L+1) &&
+                 (other.vvNumBlock[b].size() == other.L+1);
+    if (! ok)
+      throw InputErr(err_prefix + "The file is corrupted.\n");
+    if ((! vPairs.empty()) && (! other.vPairs.empty()) &&
+        (vPairs != other.vPairs))
+      throw InputErr(err_prefix + "The file uses a different set of column pairs (-pair).\n");
+    if (other.vPairs.empty() && (! vPairs.empty())) {
+      // (The file contains no data, so the pairs were never chosen.)
+      other.vPairs = vPairs;
+      other.vvCpair.assign(vPairs.size(), vector<double>(other.L+1, 0.0));
+      other.vvCpairComp = other.vvCpair;
+    }
+    other.vCrms.resize(other.L+1);
+    other.vCrmsComp.resize(other.L+1);
+    Merge(other);
+  } //Load()
+
+
+  /// @brief  Begin reading a new data set one entry at a time (using
+  ///         PushFrame()), instead of storing the entire data set in memory.
+  ///         Only the most recent L+1 entries are retained, so the memory
+  ///         required is O(L*D), regardless of the length of the data set.
+  ///         This requires that L was specified in advance, and it does not
+  ///         support periodic boundary conditions.  When subtract_ave==true,
+  ///         the sums are corrected for the average value in EndSeries()
+  ///         (so report_rms is only supported when subtract_ave==false).
+  void
+  BeginSeries(size_t D) //!< the dimension of each entry
+  {
+    if (L == 0)
+      throw InputErr("Error: Streaming requires that L is specified in advance (using \"-L\").\n");
+    if (is_periodic)
+      throw InputErr("Error: Streaming does not support periodic boundary conditions.\n");
+    if (report_rms && subtract_ave)
+      throw InputErr("Error: When streaming, -rms requires the -avezero argument.\n");
+    if (UsesCrossPairs())
+      throw InputErr("Error: Cross-correlations are not available when streaming.\n");
+    if (error_bars && (error_segments > 1))
+      throw InputErr("Error: When streaming, each data set must be a separate block\n"
+                     "       (\"-err B\" is not supported).\n");
+    Resize(L);
+    if (error_bars)
+      NewErrorBlocks(1);  // (EndSeries() adds the sums to the last block)
+    stream_D = D;
+    stream_N = 0;
+    stream_started = true;
+    aStreamRing.resize(2*(L+1)*D);
+    aStreamShift.assign(D, 0.0);
+    aStreamTotal.assign(D, 0.0);
+    aStreamPrefix.assign((L+1)*D, 0.0);
+    aStreamR.assign(L+1, 0.0);
+    aStreamRcomp.assign(L+1, 0.0);
+    aStreamBlockR.assign(L+1, 0.0);
+    if (report_rms) {
+      aStreamRsq.assign(L+1, 0.0);
+      aStreamRsqComp.assign(L+1, 0.0);
+      aStreamBlockRsq.assign(L+1, 0.0);
+    }
+  }
+
+
+  /// @brief  Was BeginSeries() invoked (and EndSeries() not yet invoked)?
+  bool SeriesStarted() const { return stream_started; }
+
+
+  /// @brief  Add the next entry, x(i), to the current data set, and update
+  ///         the sums Σ x(i-j)⋅x(i) for all 0 <= j <= min(i,L).
+  void
+  PushFrame(const Scalar *aX_d) //!< x(i), an array of size D
+  {
+    size_t D = stream_D;
+    size_t W = L+1;
+
+    // When subtracting the average, the sums are computed using
+    // y(i) = x(i) - x(0), instead of x(i), to reduce round-off error.
+    // (Subtracting a constant has no effect on the final result.)
+    if ((stream_N == 0) && subtract_ave)
+      aStreamShift.assign(aX_d, aX_d + D);
+
+    // Each entry is stored twice, at positions p and p+W in the ring buffer.
+    // This way, the most recent W entries (in reverse order) always occupy
+    // a contiguous region of memory (ending at position p+W).
+    size_t p = stream_N % W;
+    Scalar *pYnew = &aStreamRing[(p+W)*D];
+    for (size_t d=0; d < D; d++) {
+      Scalar y = aX_d[d] - aStreamShift[d];
+      pYnew[d] = y;
+      aStreamRing[p*D + d] = y;
+    }
+
+    if (stream_N < L)
+      for (size_t d=0; d < D; d++)
+        aStreamPrefix[(stream_N+1)*D + d] = aStreamPrefix[stream_N*D + d] + pYnew[d];
+    for (size_t d=0; d < D; d++)
+      aStreamTotal[d] += pYnew[d];
+
+    size_t jmax = stream_N;
+    if (jmax > L)
+      jmax = L;
+    const Scalar *pYold = pYnew;
+    for (size_t j=0; j <= jmax; ++j, pYold -= D) {
+      double C = 0.0;
+      for (size_t d=0; d < D; d++)
+        C += static_cast<double>(pYnew[d]) * static_cast<double>(pYold[d]);
+      aStreamBlockR[j] += C;
+      if (report_rms)
+        aStreamBlockRsq[j] += C*C;
+    }
+    stream_N++;
+    // Periodically add the recent sums to the totals (compensated summation)
+    if (stream_N % stream_block_size == 0)
+      FlushStreamBlock(stream_block_size);
+  } //PushFrame()
+
+
+  /// @brief  Finish processing the current data set (and add its
+  ///         contribution to vC[j], vCrms[j], and vNumSamples[j]).
+  void
+  EndSeries()
+  {
+    size_t N = stream_N;
+    size_t D = stream_D;
+    size_t W = L+1;
+    stream_started = false;
+    if (N == 0)
+      return;
+    FlushStreamBlock(N % stream_block_size);
+    size_t jmax = N-1;
+    if (jmax > L)
+      jmax = L;
+
+    // Let m = ⟨y⟩.  Then for each j:
+    // Σ_{i=0}^{N-1-j} (y(i)-m)⋅(y(i+j)-m)
+    //    = Σ y(i)⋅y(i+j) - m⋅(Σ_{i<N-j} y(i) + Σ_{i>=j} y(i)) + (N-j) m⋅m
+    vector<double> m(D, 0.0);
+    vector<double> aSuffix(D, 0.0); // Σ_{i>=N-j} y(i)  (the last j entries)
+    double m_dot_m = 0.0;
+    if (subtract_ave) {
+      for (size_t d=0; d < D; d++) {
+        m[d] = aStreamTotal[d] / N;
+        m_dot_m += m[d]*m[d];
+      }
+    }
+
+    size_t p_last = (N-1) % W; // the location of the last entry in the ring
+    for (size_t j=0; j <= jmax; ++j) {
+      double C = aStreamR[j] + aStreamRcomp[j];
+      if (subtract_ave) {
+        double m_dot_sums = 0.0;
+        for (size_t d=0; d < D; d++)
+          m_dot_sums += m[d] * ((aStreamTotal[d] - aSuffix[d]) +
+                                (aStreamTotal[d] - aStreamPrefix[j*D + d]));
+        C += (N-j)*m_dot_m - m_dot_sums;
+        // update the suffix sum (add y(N-1-j))
+        const Scalar *pY = &aStreamRing[(p_last + W - j)*D];
+        for (size_t d=0; d < D; d++)
+          aSuffix[d] += pY[d];
+      }
+      AddSums(j, C, (report_rms ? aStreamRsq[j] + aStreamRsqComp[j] : 0.0), N-j);
+      if (error_bars)
+        AddBlockSums(vvCblock.size()-1, j, C, N-j);
+    }
+    stream_N = 0;
+  } //EndSeries()
+
 
 
 
@@ -242,8 +1108,28 @@ public:
       vC.resize(L+1);
     if (L+1 < vCrms.size())
       vCrms.resize(L+1);
+    for (size_t p=0; p < vvCpair.size(); p++)
+      vvCpair[p].resize(L+1);
+    for (size_t b=0; b < vvCblock.size(); b++) {
+      vvCblock[b].resize(L+1);
+      vvNumBlock[b].resize(L+1);
+    }
 
     for (size_t j=0; j < L+1; ++j) {
+      // include the round-off error from compensated summation
+      vC[j] += vCcomp[j];
+      vCcomp[j] = 0.0;
+      if (report_rms) {
+        vCrms[j] += vCrmsComp[j];
+        vCrmsComp[j] = 0.0;
+      }
+      for (size_t p=0; p < vvCpair.size(); p++) {
+        vvCpair[p][j] += vvCpairComp[p][j];
+        vvCpairComp[p][j] = 0.0;
+        vvCpair[p][j] = ((vNumSamples[j] > 0)
+                         ? vvCpair[p][j] / vNumSamples[j]
+                         : 0.0);
+      }
       if (vNumSamples[j] > 0) {
         double Cave = vC[j] / vNumSamples[j];
         double Csqave = 0.0;
@@ -260,19 +1146,58 @@ public:
       }
       else {
         vC[j] = 0.0;
-        vCrms[j] = 0.0;
+        if (report_rms)
+          vCrms[j] = 0.0;
+      }
+    }
+
+    if (error_bars) {
+      // Estimate the uncertainty in C(j) from the variation between blocks.
+      // First, replace the sums in vvCblock[b][j] with the estimate of C(j)
+      // from block b (or, for the jackknife, from all blocks except b).
+      for (size_t b=0; b < vvCblock.size(); b++) {
+        for (size_t j=0; j < L+1; ++j) {
+          size_t n = vNumSamples[j];
+          size_t n_b = vvNumBlock[b][j];
+          double &C_b = vvCblock[b][j];
+          if (jackknife)
+            C_b = (n > n_b) ? (vC[j]*n - C_b) / (n - n_b) : 0.0;
+          else
+            C_b = (n_b > 0) ? C_b / n_b : 0.0;
+        }
+      }
+      vCerr.assign(L+1, 0.0);
+      vector<double> vCb, vWb;
+      for (size_t j=0; j < L+1; ++j) {
+        vCb.clear();
+        vWb.clear();
+        for (size_t b=0; b < vvCblock.size(); b++) {
+          if (vvNumBlock[b][j] == 0)
+            continue;
+          vCb.push_back(vvCblock[b][j]);
+          vWb.push_back(static_cast<double>(vvNumBlock[b][j]) / vNumSamples[j]);
+        }
+        vCerr[j] = StandardError(vCb, vWb);
       }
     }
   } //Finalize()
 
   /// @brief  Sum all of the entries in vC.  Do this after invoking Finalize()
-  Scalar
-  Integrate() {
-    Scalar integral_of_C = 0.0;
-    assert(L+1 <= vC.size());
+  double
+  Integrate() const {
+    return Integrate(vC);
+  }
+
+  /// @brief  Sum all of the entries in a correlation function, vCurve
+  ///         (for example, vvCpair[p]).  Do this after invoking Finalize()
+  /// @overloaded
+  double
+  Integrate(const vector<double> &vCurve) const {
+    double integral_of_C = 0.0;
+    assert(L+1 <= vCurve.size());
     for (size_t j=0; j <= L; ++j) {
-      if ((vNumSamples[j] > 0) && (vC[j] > threshold * vC[0]))
-        integral_of_C += vC[j];
+      if ((vNumSamples[j] > 0) && (vCurve[j] > threshold * vCurve[0]))
+        integral_of_C += vCurve[j];
       else
         break;
     }
@@ -284,24 +1209,32 @@ public:
   /// Use linear interpolation to find the fractional j value close to the
   /// place where the plot of vC[j]/vC[0] drops below that threshold.
   /// If vC[j]/vC[0] remains above the threshold for all j values, return -1.0.
-  Scalar
-  ThresholdCrossing(Scalar thresh) {
-    assert(L+1 <= vC.size());
+  double
+  ThresholdCrossing(double thresh) const {
+    return ThresholdCrossing(thresh, vC);
+  }
+
+  /// @brief  Find where a correlation function, vCurve, (for example,
+  ///         vvCpair[p]) drops below "thresh".
+  /// @overloaded
+  double
+  ThresholdCrossing(double thresh, const vector<double> &vCurve) const {
+    assert(L+1 <= vCurve.size());
     size_t j_prev = 0;
-    Scalar j_threshold = 0.0;
-    Scalar delta_j = -1.0;
-    for (size_t j=1; j < vC.size(); j++) {
+    double j_threshold = 0.0;
+    double delta_j = -1.0;
+    for (size_t j=1; j < vCurve.size(); j++) {
       if (vNumSamples[j] == 0) //ignore j entries which lack data (if present)
         continue;
-      if (vC[j] < thresh * vC[0]) {
+      if (vCurve[j] < thresh * vCurve[0]) {
         delta_j =
-          (thresh*vC[0] - vC[j_prev])/(vC[j]-vC[j_prev]);
+          (thresh*vCurve[0] - vCurve[j_prev])/(vCurve[j]-vCurve[j_prev]);
         break;
       }
       j_prev = j;
     }
     if (delta_j >= 0.0) {
-      Scalar j_thresh = j_prev + delta_j;
+      double j_thresh = j_prev + delta_j;
       return j_thresh;
     }
     else return -1.0;
@@ -309,17 +1242,42 @@ public:
 
   /// @brief  Calculate the correlation length
   ///     (Note: For time series data, this is called the "correlation time".)
-  Scalar
-  GuessCorrelationLength() {
+  double
+  GuessCorrelationLength() const {
+    return GuessCorrelationLength(vC);
+  }
+
+  /// @brief  Estimate the standard error of the correlation length
+  ///         (from the correlation lengths of each block, or from the
+  ///          jackknife).  This requires SetErrorBlocks().
+  ///         Do this after invoking Finalize().
+  double
+  CorrelationLengthError() const {
+    vector<double> vLb, vWb;
+    for (size_t b=0; b < vvCblock.size(); b++) {
+      if (vvNumBlock[b][0] == 0)
+        continue;
+      vLb.push_back(GuessCorrelationLength(vvCblock[b]));
+      vWb.push_back(static_cast<double>(vvNumBlock[b][0]) / vNumSamples[0]);
+    }
+    return StandardError(vLb, vWb);
+  }
+
+  /// @brief  Calculate the correlation length of a correlation function,
+  ///         vCurve (for example, vvCpair[p], the autocorrelation of one
+  ///         column).  Do this after invoking Finalize().
+  /// @overloaded
+  double
+  GuessCorrelationLength(const vector<double> &vCurve) const {
     // Pick a point along the curve ("j_thresh").
-    // Estimate correlation length by observing how much vC[j_thresh] has
+    // Estimate correlation length by observing how much vCurve[j_thresh] has
     // decayed, and fitting this to an exponential decay.
-    Scalar j_thresh = -1.0;
-    Scalar C_thresh = -1.0;
+    double j_thresh = -1.0;
+    double C_thresh = -1.0;
     if (persistence_length_threshold > -1.0) {
       // If the "persistence_length_threshold" parameter was specified, then we
       // set "j_thresh" to the point on the curve that crosses this threshold.
-      j_thresh = ThresholdCrossing(persistence_length_threshold);
+      j_thresh = ThresholdCrossing(persistence_length_threshold, vCurve);
       C_thresh = persistence_length_threshold;
     }
 
@@ -327,7 +1285,7 @@ public:
     //else if (L > 0) {
     //  // If not, then we set "j_thresh" to the last entry in the curve
     //  j_thresh = L;
-    //  C_thresh = vC[j_thresh];
+    //  C_thresh = vCurve[j_thresh];
     //}
     // In retrospect, this was a bad idea.  I want to allow the user to
     // specify extremely large L values.  In that case, it's probably more
@@ -335,21 +1293,22 @@ public:
 
 
     // Now choose which method to use to calculate the persistence length:
-    Scalar persistence_length;
+    double persistence_length;
 
     // If j_thresh and C_thresh are both positive (not pathelogical), then
     // assume the curve is a decaying exponential.  In that case we can
     // use j_thresh and C_thresh to estimate the rate of decay.
     // (The persistence length is one over this rate.)
     if ((j_thresh > 0.0) && (C_thresh > 0.0)) {
-      persistence_length = -j_thresh / log(C_thresh / vC[0]);
+      // (C_thresh is a fraction of vCurve[0], as in ThresholdCrossing())
+      persistence_length = -j_thresh / log(C_thresh);
     }
     else {
       // Otherwise, estimate the correlation length from the
       // integral of the correlation function.
       // (This is numerically unstable, so do this only as a last resort.)
-      Scalar integral_of_C = Integrate();
-      persistence_length = integral_of_C / vC[0];
+      double integral_of_C = Integrate(vCurve);
+      persistence_length = integral_of_C / vCurve[0];
     }
 
     return persistence_length;
@@ -360,11 +1319,1043 @@ public:
 
 private:
 
+  /// @brief Accumulate the sums used to calculate vC[j] from one or more data
+  ///        sets, stopping at the first j where C(j) < threshold * C(0)
+  ///        (where C(j) is averaged over all of the data sets, including
+  ///        those from previous invocations).
+  ///        The separations (j values) are processed in blocks, in order.
+  ///        Within each block, the sums for every (data set, j) pair are
+  ///        computed in parallel.  Then the results are added to vC[j] (in
+  ///        order), checking the threshold after each j.  Once it is crossed,
+  ///        no more blocks are started, and the remaining results from the
+  ///        current block are discarded.  (So lags beyond the cutoff are
+  ///        mostly never computed, and the result does not depend on the
+  ///        number of threads.)
+  template<typename T>
+  size_t
+  AccumulateThreshold(const vector<DataView<T> > &vX_n) //!< the data sets
+  {
+    return AccumulateThreshold(vX_n,
+                               [&](size_t n, size_t ld, vector<Scalar> &aX) {
+                                 CopyColumns(vX_n[n], ld, aX);
+                               });
+  }
+
+
+  /// @brief  The same calculation, for data sets which can be rearranged
+  ///         in place (see TakeColumns()).
+  size_t
+  AccumulateThreshold(vector<DataSet<Scalar> > &&vX_n) //!< the data sets
+  {
+    vector<DataView<Scalar> > vViews(vX_n.size());
+    for (size_t n=0; n < vX_n.size(); n++)
+      vViews[n] = vX_n[n].view();
+    return AccumulateThreshold(vViews,
+                               [&](size_t n, size_t ld, vector<Scalar> &aX) {
+                                 TakeColumns(vX_n[n], ld, aX);
+                               });
+  }
+
+
+  /// @brief  The same calculation.  get_columns(n, ld, aX) stores data set
+  ///         n in aX (see CopyColumns()).  (Only the size and dimension of
+  ///         the data sets in vX_n are used.)
+  template<typename T, typename GetColumns>
+  size_t
+  AccumulateThreshold(const vector<DataView<T> > &vX_n, //!< the data sets
+                      GetColumns get_columns)
+  {
+    size_t num_sets = vX_n.size();
+    if (num_sets == 0)
+      return L;
+    for (size_t n=0; n < num_sets; n++)
+      ChooseL(vX_n[n].size());
+    ChoosePairs(vX_n[0].dim());
+    PrepareCostModel(vX_n);
+
+    // Store each data set in column-major order (see AccumulateDataSet())
+    vector<vector<Scalar> > vaX(num_sets);
+    vector<size_t> vN(num_sets), vD(num_sets), vLd(num_sets), vJmax(num_sets);
+    size_t jmax = 0;  // the largest j value needed by any data set
+    for (size_t n=0; n < num_sets; n++) {
+      vN[n] = vX_n[n].size();
+      vD[n] = vX_n[n].dim();
+      vJmax[n] = (vN[n] > L) ? L : vN[n];
+      vLd[n] = vN[n] + (is_periodic ? vJmax[n] : 0);
+      get_columns(n, vLd[n], vaX[n]);
+      if ((vN[n] > 0) && (vJmax[n] > jmax))
+        jmax = vJmax[n];
+    }
+
+    // Keep track of the work requested (and finished).  (The work beyond
+    // the point where C(j) is truncated is discarded.  See ProgressReporter.)
+    double work_requested = 0.0;
+    double work_done = 0.0;
+    for (size_t n=0; n < num_sets; n++)
+      work_requested += NumProducts(vN[n], vD[n], 0, vJmax[n]+1);
+    if (pProgress)
+      pProgress->AddWork(work_requested);
+
+    // (When estimating errors, each data set contributes num_seg blocks.
+    //  The blocks from data set n begin at b0 + n*num_seg.)
+    size_t num_seg = error_bars ? error_segments : 0;
+    size_t b0 = NewErrorBlocks(num_sets * num_seg);
+    assert((num_seg <= 1) || (engine != ENGINE_FFT)); // (see SetErrorBlocks())
+
+    // Once C(j) has been truncated, compute the cross-correlations (if
+    // requested) for the remaining lags.  (These do not effect the threshold.)
+    // Also record which engine was used ("used_engine").
+    auto finish = [&](Engine used_engine) {
+      for (size_t n=0; n < num_sets; n++)
+        if (vN[n] > 0)
+          CountDataSet(used_engine);
+      for (size_t n=0; n < num_sets; n++)
+        AccumulatePairs(vaX[n], vN[n], vLd[n], vD[n], min(vJmax[n], L));
+      if (pProgress)
+        pProgress->RemoveWork(work_requested - work_done);
+      return L;
+    };
+
+    // The FFT computes every j at once, so there is nothing to gain from
+    // processing the j values in blocks.  Truncate the sum afterwards.
+    // (If the direct method was used for the lags before j_start, then
+    //  only the remaining lags are used.)
+    auto accumulate_fft = [&](size_t j_start) {
+      vector<double> aC(jmax+1, 0.0), aCsq(report_rms ? jmax+1 : 0, 0.0);
+      vector<size_t> aNumSamples(jmax+1, 0);
+      for (size_t n=0; n < num_sets; n++) {
+        if (num_seg == 0) {
+          AccumulateFFT(vaX[n], vN[n], vLd[n], vD[n], vJmax[n],
+                        aC, aCsq, aNumSamples);
+          continue;
+        }
+        // (Keep track of the sums from each data set separately.)
+        vector<double> aCn(jmax+1, 0.0), aCsqN(aCsq.size(), 0.0);
+        vector<size_t> aNumN(jmax+1, 0);
+        AccumulateFFT(vaX[n], vN[n], vLd[n], vD[n], vJmax[n],
+                      aCn, aCsqN, aNumN);
+        for (size_t j=0; j <= jmax; ++j) {
+          aC[j] += aCn[j];
+          if (report_rms)
+            aCsq[j] += aCsqN[j];
+          aNumSamples[j] += aNumN[j];
+          if (j >= j_start)
+            AddBlockSums(b0+n, j, aCn[j], aNumN[j]);
+        }
+      }
+      if (pProgress)
+        pProgress->AddDone(work_requested - work_done);
+      work_done = work_requested;
+      for (size_t j=j_start; j <= jmax; ++j) {
+        AddSums(j, aC[j], (report_rms ? aCsq[j] : 0.0), aNumSamples[j]);
+        if ((vC[j] < threshold * vC[0]) && (j < jmax)) {
+          L = j;       //This will truncate the correlation function.
+          break;
+        }
+      }
+      return finish(ENGINE_FFT);
+    };
+
+    if (engine == ENGINE_FFT)
+      return accumulate_fft(0);
+
+    // With ENGINE_AUTO, the lag where C(j) will be truncated is not known in
+    // advance (so neither is the cost of the direct method).  Begin using the
+    // direct method, and switch to the FFT (for the remaining lags) before
+    // the (predicted) time spent on the direct method exceeds the time the
+    // FFT needs.  (This is never much more than twice as slow as the faster
+    // choice.  If the FFT is faster than the first block of lags, it is used
+    // from the beginning.)
+    bool auto_engine = (engine == ENGINE_AUTO) && (num_seg <= 1);
+    double fft_cost = 0.0;     // the predicted time needed by the FFT
+    double direct_cost = 0.0;  // the predicted time spent so far (direct)
+    for (size_t n=0; auto_engine && (n < num_sets); n++)
+      fft_cost += FFTCost(vN[n], vD[n]);
+
+    vector<typename LagSumKernel<Scalar>::type> vLagSum(num_sets);
+    for (size_t n=0; n < num_sets; n++)
+      vLagSum[n] = ChooseLagSumKernel<Scalar>(vD[n], report_rms);
+
+    // the number of j values in each block
+    size_t block_size = 64;
+    size_t max_threads = 1;
+    #ifndef DISABLE_OPENMP
+    max_threads = static_cast<size_t>(omp_get_max_threads());
+    #endif
+    if (block_size < 4 * max_threads)
+      block_size = 4 * max_threads;
+
+    vector<double> aBlockC(num_sets * block_size);
+    vector<double> aBlockCsq(num_sets * block_size);
+    // the sums from each segment (if num_seg > 1)
+    vector<double> aSegC((num_seg > 1) ? num_sets * num_seg * block_size : 0);
+
+    // Each task computes the sums for a sub-block of lags from one data set
+    // (one cache-sized tile at a time, see LagBlockSum()).
+    size_t sub_block = block_size;
+    if (parallelize_lags)
+      sub_block = (block_size + max_threads - 1) / max_threads;
+    vector<LagTile> vTile(num_sets);
+    for (size_t n=0; n < num_sets; n++) {
+      vTile[n] = ChooseLagTile(vN[n], vD[n], sizeof(Scalar));
+      if (vTile[n].j > sub_block)
+        vTile[n].j = sub_block;
+    }
+
+    for (size_t j_begin=0; j_begin <= jmax; j_begin += block_size)
+    {
+      size_t j_end = j_begin + block_size;  // (one past the last j)
+      if (j_end > jmax+1)
+        j_end = jmax+1;
+      if (auto_engine) {
+        double block_products = 0.0;
+        for (size_t n=0; n < num_sets; n++)
+          if (j_begin <= vJmax[n])
+            block_products += NumProducts(vN[n], vD[n], j_begin,
+                                          min(j_end, vJmax[n]+1));
+        direct_cost += cost_model.DirectCost(block_products, report_rms,
+                                             NumThreads());
+        if (direct_cost > fft_cost)
+          return accumulate_fft(j_begin);
+      }
+      size_t num_sub = (j_end - j_begin + sub_block - 1) / sub_block;
+      size_t num_tasks = num_sets * num_sub;
+
+      #pragma omp parallel for schedule(dynamic) if (parallelize_lags)
+      for (size_t task=0; task < num_tasks; task++)
+      {
+        double t_begin = pProfiler ? Profiler::Now() : 0.0;
+        size_t n = task / num_sub;
+        size_t j_sub = j_begin + (task % num_sub) * sub_block;
+        size_t j_sub_end = j_sub + sub_block;
+        if (j_sub_end > j_end)
+          j_sub_end = j_end;
+        double *aC = &aBlockC[n*block_size + (j_sub - j_begin)];
+        double *aCsq = &aBlockCsq[n*block_size + (j_sub - j_begin)];
+        fill(aC, aC + (j_sub_end - j_sub), 0.0);
+        fill(aCsq, aCsq + (j_sub_end - j_sub), 0.0);
+        if (vN[n] == 0)
+          continue;
+        if (j_sub_end > vJmax[n]+1)
+          j_sub_end = vJmax[n]+1;
+        if (j_sub_end <= j_sub)
+          continue;
+        if (num_seg <= 1) {
+          for (size_t j0=j_sub; j0 < j_sub_end; j0 += vTile[n].j) {
+            size_t j1 = min(j0 + vTile[n].j, j_sub_end);
+            LagBlockSum<Scalar>(vLagSum[n], vaX[n].data(), vLd[n], vD[n], vN[n],
+                                is_periodic, j0, j1, vTile[n].i,
+                                aC + (j0 - j_sub), aCsq + (j0 - j_sub));
+          }
+          if (pProfiler)
+            pProfiler->AddKernelTime(Profiler::Now() - t_begin,
+                                     NumProducts(vN[n], vD[n], j_sub, j_sub_end));
+          continue;
+        }
+        // Compute the sums from each segment separately (see AccumulateSingle())
+        vector<double> aCsqSeg(j_sub_end - j_sub);
+        for (size_t s=0; s < num_seg; s++) {
+          size_t i_first = SegmentBegin(vN[n], num_seg, s);
+          size_t i_last = SegmentBegin(vN[n], num_seg, s+1);
+          double *aCseg = &aSegC[(n*num_seg + s)*block_size + (j_sub - j_begin)];
+          fill(aCseg, aCseg + (j_sub_end - j_sub), 0.0);
+          fill(aCsqSeg.begin(), aCsqSeg.end(), 0.0);
+          for (size_t j0=j_sub; j0 < j_sub_end; j0 += vTile[n].j) {
+            size_t j1 = min(j0 + vTile[n].j, j_sub_end);
+            LagBlockSum<Scalar>(vLagSum[n], vaX[n].data(), vLd[n], vD[n], vN[n],
+                                is_periodic, j0, j1, vTile[n].i,
+                                aCseg + (j0 - j_sub), &aCsqSeg[j0 - j_sub],
+                                i_first, i_last);
+          }
+          for (size_t j=j_sub; j < j_sub_end; j++) {
+            aC[j - j_sub] += aCseg[j - j_sub];
+            aCsq[j - j_sub] += aCsqSeg[j - j_sub];
+          }
+        }
+        if (pProfiler)
+          pProfiler->AddKernelTime(Profiler::Now() - t_begin,
+                                   NumProducts(vN[n], vD[n], j_sub, j_sub_end));
+      }
+
+      if (pProgress) {
+        double work_block = 0.0;
+        for (size_t n=0; n < num_sets; n++)
+          if (j_begin <= vJmax[n])
+            work_block += NumProducts(vN[n], vD[n], j_begin,
+                                      min(j_end, vJmax[n]+1));
+        pProgress->AddDone(work_block);
+        work_done += work_block;
+      }
+
+      // Add the results to vC[j] (in order), and check for threshold violations.
+      for (size_t j=j_begin; j < j_end; ++j) {
+        for (size_t n=0; n < num_sets; n++) {
+          if ((vN[n] == 0) || (j > vJmax[n]))
+            continue;
+          size_t k = n*block_size + (j - j_begin);
+          AddSums(j, aBlockC[k], aBlockCsq[k],
+                  is_periodic ? vN[n] : vN[n]-j);
+          if (num_seg == 1)
+            AddBlockSums(b0+n, j, aBlockC[k], is_periodic ? vN[n] : vN[n]-j);
+          for (size_t s=0; (num_seg > 1) && (s < num_seg); s++)
+            AddBlockSums(b0 + n*num_seg + s, j,
+                         aSegC[(n*num_seg + s)*block_size + (j - j_begin)],
+                         NumTerms(vN[n], j, SegmentBegin(vN[n], num_seg, s),
+                                  SegmentBegin(vN[n], num_seg, s+1)));
+        }
+        // If the covariance function is too low, then quit
+        if ((vC[j] < threshold * vC[0]) && (j < jmax)) {
+          L = j;       //This will truncate the correlation function.
+          return finish(ENGINE_DIRECT);
+        }
+      }
+    } //for (size_t j_begin=0; j_begin <= jmax; j_begin += block_size)
+
+    return finish(ENGINE_DIRECT);
+  } //AccumulateThreshold()
+
+
+  /// @brief Copy the data set into aX (in column-major order), subtracting
+  ///        the average (if requested).  Each column has length ld >= N.
+  ///        Entries beyond N wrap around:  x_d(i) = x_d(i-N)  (N <= i < ld)
+  template<typename T>
+  void
+  CopyColumns(const DataView<T> &X_id, //!< the original data
+              size_t ld,               //!< the length of each column
+              vector<Scalar> &aX)      //!< store the copy here
+  {
+    double t_begin = pProfiler ? Profiler::Now() : 0.0;
+    size_t N = X_id.size();
+    size_t D = X_id.dim();
+    assert(ld >= N);
+    vector<double> x_ave(D, 0.0);  // (always computed in double precision)
+    if (subtract_ave && (N > 0)) {
+      for (size_t i=0; i < N; i++)
+        for (size_t d=0; d < D; d++)
+          x_ave[d] += X_id(i, d);
+      for (size_t d=0; d < D; d++)
+        x_ave[d] /= N;
+    }
+    aX.resize(D*ld);
+    for (size_t d=0; d < D; d++) {
+      Scalar *pXd = &aX[d*ld];
+      for (size_t i=0; i < N; i++)
+        pXd[i] = static_cast<Scalar>(X_id(i, d) - x_ave[d]);
+      for (size_t i=N; i < ld; i++)
+        pXd[i] = pXd[i - N];
+    }
+    if (pProfiler)
+      pProfiler->AddCopyTime(Profiler::Now() - t_begin);
+  } //CopyColumns()
+
+
+  /// @brief The same as CopyColumns(), except that the data set's own memory
+  ///        is used (after rearranging the data in place and moving it into
+  ///        aX), so the data is never duplicated.  Afterwards, X_id is empty.
+  ///        (The results are identical to CopyColumns().)
+  void
+  TakeColumns(DataSet<Scalar> &X_id, //!< the original data
+              size_t ld,             //!< the length of each column
+              vector<Scalar> &aX)    //!< store the data here
+  {
+    double t_begin = pProfiler ? Profiler::Now() : 0.0;
+    size_t N = X_id.size();
+    size_t D = X_id.dim();
+    assert(ld >= N);
+    X_id.SetLayout(DataSet<Scalar>::COLUMN_MAJOR, true);
+    X_id.Release(aX);
+    // (In the periodic case, each column is moved to make room for the
+    //  entries which wrap around, beginning with the last column.)
+    aX.resize(D*ld);
+    for (size_t d=D; (ld > N) && (d > 1); d--)
+      copy_backward(&aX[(d-1)*N], &aX[(d-1)*N] + N, &aX[(d-1)*ld] + N);
+    for (size_t d=0; d < D; d++) {
+      Scalar *pXd = &aX[d*ld];
+      // (The average is computed the same way as in CopyColumns().)
+      double x_ave = 0.0;
+      if (subtract_ave && (N > 0)) {
+        for (size_t i=0; i < N; i++)
+          x_ave += pXd[i];
+        x_ave /= N;
+      }
+      for (size_t i=0; i < N; i++)
+        pXd[i] = static_cast<Scalar>(pXd[i] - x_ave);
+      for (size_t i=N; i < ld; i++)
+        pXd[i] = pXd[i - N];
+    }
+    if (pProfiler)
+      pProfiler->AddCopyTime(Profiler::Now() - t_begin);
+  } //TakeColumns()
+
+
+  /// @brief Add the sums used to calculate C(j) (and Crms(j)) from a single
+  ///        data set to aC[j] (and aCsq[j]) using the FFT.  The data set has
+  ///        already been shifted by the average (if requested) and copied
+  ///        into aX (in column-major order).  The number of terms in each sum
+  ///        is added to aNumSamples[j].
+  ///        The results agree with the direct method (up to round-off error).
+  void
+  AccumulateFFT(const vector<Scalar> &aX, //!< x_d(i) = aX[d*ld+i]
+                size_t N,    //!< the number of entries in the data set
+                size_t ld,   //!< the length of each column in aX
+                size_t D,    //!< the number of columns
+                size_t jmax, //!< compute C(j) for 0 <= j <= jmax
+                vector<double> &aC,   //!< add Σ_i x(i)⋅x(i+j) to aC[j]
+                vector<double> &aCsq, //!< add Σ_i (x(i)⋅x(i+j))^2 to aCsq[j]
+                vector<size_t> &aNumSamples) //!< add the number of terms
+  {
+    double t_begin = pProfiler ? Profiler::Now() : 0.0;
+    vector<double> aA;
+    AutoCorrelateFFT(N, D,
+                     [&](size_t d, size_t i) {
+                       return static_cast<double>(aX[d*ld + i]);
+                     },
+                     aA);
+
+    // The rms calculation requires sums of (x(i)⋅x(i+j))^2, which equal
+    //   Σ_{d,e} Σ_i (x_d(i)*x_e(i)) * (x_d(i+j)*x_e(i+j))
+    // This is the (summed) autocorrelation of the D*(D+1)/2 series
+    // y_de(i) = x_d(i)*x_e(i)  (d <= e),  where the terms with d != e
+    // are counted twice (scale those series by sqrt(2)).
+    vector<double> aAsq;
+    if (report_rms) {
+      vector<size_t> vd, ve;
+      for (size_t d=0; d < D; d++) {
+        for (size_t e=d; e < D; e++) {
+          vd.push_back(d);
+          ve.push_back(e);
+        }
+      }
+      AutoCorrelateFFT(N, vd.size(),
+                       [&](size_t s, size_t i) {
+                         double y = (static_cast<double>(aX[vd[s]*ld + i]) *
+                                     static_cast<double>(aX[ve[s]*ld + i]));
+                         if (vd[s] != ve[s])
+                           y *= M_SQRT2;
+                         return y;
+                       },
+                       aAsq);
+    }
+
+    for (size_t j=0; j <= jmax; ++j)
+    {
+      double C = 0.0;
+      double Csq = 0.0;
+      if (is_periodic) {
+        // The periodic sum is the sum of two non-periodic sums:
+        //  Σ_i x(i)*x((i+j)%N) = Σ_{i<N-j} x(i)*x(i+j) + Σ_{i<j} x(i)*x(i+N-j)
+        // (So we can use the same zero-padded transform in both cases.)
+        size_t jj = j % N;
+        C = aA[jj];
+        if (jj > 0)
+          C += aA[N-jj];
+        if (report_rms) {
+          Csq = aAsq[jj];
+          if (jj > 0)
+            Csq += aAsq[N-jj];
+        }
+        aNumSamples[j] += N;
+      }
+      else {
+        if (j < N) {
+          C = aA[j];
+          if (report_rms)
+            Csq = aAsq[j];
+          aNumSamples[j] += N-j;
+        }
+      }
+
+      aC[j] += C;
+      if (report_rms)
+        aCsq[j] += Csq;
+    }
+    // (The number of products reported is the number which the direct
+    //  method would have computed.)
+    if (pProfiler)
+      pProfiler->AddKernelTime(Profiler::Now() - t_begin,
+                               NumProducts(N, D, 0, jmax+1));
+  } //AccumulateFFT()
+
+
+  /// @brief  Return an object with the same settings as this one, whose
+  ///         sums (vC, vCrms, vNumSamples) are all zero.  It will not
+  ///         use multiple threads when processing individual data sets.
+  NdAutocrr
+  EmptyCopy() const
+  {
+    NdAutocrr copy(*this);
+    copy.vC.assign(vC.size(), 0.0);
+    copy.vCcomp.assign(vCcomp.size(), 0.0);
+    copy.vCrms.assign(vCrms.size(), 0.0);
+    copy.vCrmsComp.assign(vCrmsComp.size(), 0.0);
+    for (size_t p=0; p < vvCpair.size(); p++) {
+      copy.vvCpair[p].assign(vvCpair[p].size(), 0.0);
+      copy.vvCpairComp[p].assign(vvCpairComp[p].size(), 0.0);
+    }
+    copy.vNumSamples.assign(vNumSamples.size(), 0);
+    copy.vvCblock.clear();
+    copy.vvNumBlock.clear();
+    copy.num_direct_sets = 0;
+    copy.num_fft_sets = 0;
+    copy.parallelize_lags = false;
+    copy.pCalibrationLog = nullptr;  // (only the original measures cost_model)
+    return copy;
+  }
+
+
+  /// @brief  Divide a list of data sets into chunks of consecutive data sets
+  ///         which require a similar amount of computation.
+  ///         Chunk c contains data sets vChunkBegin[c] <= n < vChunkBegin[c+1].
+  ///         This only depends on the data (not on the number of threads).
+  ///         A single chunk is returned if the data sets should instead be
+  ///         processed one at a time (for example, when there are only a few
+  ///         large data sets, or when the threshold is used to truncate C(j),
+  ///         which requires processing the data sets in order).
+  template<typename T>
+  void
+  ChunkDataSets(const vector<DataView<T> > &vX_n,
+                vector<size_t> &vChunkBegin) const
+  {
+    // Each chunk needs its own copy of vC, so limit the number of chunks.
+    const size_t max_chunks = 256;
+    const size_t max_accumulator_entries = (1 << 24);
+    // Chunks should contain at least this many products x(i)⋅x(i+j)
+    const double min_chunk_cost = 1.0e6;
+
+    vChunkBegin.assign(1, 0);
+    size_t num_chunks = vX_n.size();
+    if (num_chunks > max_chunks)
+      num_chunks = max_chunks;
+    if (num_chunks > max_accumulator_entries / (L+1))
+      num_chunks = max_accumulator_entries / (L+1);
+    double total_cost = 0.0;
+    for (size_t n=0; n < vX_n.size(); n++)
+      total_cost += DataSetCost(vX_n[n]);
+    if (num_chunks > total_cost / min_chunk_cost)
+      num_chunks = total_cost / min_chunk_cost;
+    if ((threshold > -1.0) || (L == 0) || (num_chunks <= 1)) {
+      vChunkBegin.push_back(vX_n.size());
+      return;
+    }
+
+    double cost = 0.0;
+    for (size_t n=0; n < vX_n.size(); n++) {
+      cost += DataSetCost(vX_n[n]);
+      if ((cost >= total_cost * vChunkBegin.size() / num_chunks) &&
+          (n+1 < vX_n.size()))
+        vChunkBegin.push_back(n+1);
+    }
+    vChunkBegin.push_back(vX_n.size());
+  } //ChunkDataSets()
+
+
+  /// @brief  Estimate the number of products x(i)⋅x(i+j) that must be
+  ///         computed for a given data set.
+  template<typename T>
+  double
+  DataSetCost(const DataView<T> &X_id) const
+  {
+    double N = X_id.size();
+    double num_lags = (L+1 < N) ? L+1 : N;
+    return N * num_lags * (X_id.dim() > 0 ? X_id.dim() : 1);
+  }
+
+
+  /// @brief  The number of products x_d(i)⋅x_d(i+j) computed for a given
+  ///         data set (when no threshold is used).  (See ProgressReporter.)
+  template<typename T>
+  double
+  DataSetWork(const DataView<T> &X_id) const
+  {
+    size_t N = X_id.size();
+    size_t jmax = (N > L) ? L : N;
+    return NumProducts(N, X_id.dim(), 0, jmax+1);
+  }
+
+
+  /// @brief  Estimate the standard error of a quantity from its values in
+  ///         each block, vQb[b] (or, for the jackknife, from its values
+  ///         when each block is omitted).  vWb[b] is the fraction of the
+  ///         data contained in block b.
+  double
+  StandardError(const vector<double> &vQb,
+                const vector<double> &vWb) const
+  {
+    size_t B = vQb.size();
+    if (B < 2)
+      return 0.0;
+    double var = 0.0;
+    if (jackknife) {
+      double ave = 0.0;
+      for (size_t b=0; b < B; b++)
+        ave += vQb[b];
+      ave /= B;
+      for (size_t b=0; b < B; b++)
+        var += (vQb[b] - ave) * (vQb[b] - ave);
+      var *= (B - 1.0) / B;
+    }
+    else {
+      // (The weighted average of the blocks is the overall average.)
+      double ave = 0.0;
+      double sum_w = 0.0;
+      for (size_t b=0; b < B; b++) {
+        ave += vWb[b] * vQb[b];
+        sum_w += vWb[b];
+      }
+      ave /= sum_w;
+      for (size_t b=0; b < B; b++) {
+        double w = vWb[b] / sum_w;
+        var += w*w * (vQb[b] - ave) * (vQb[b] - ave);
+      }
+      var *= B / (B - 1.0);
+    }
+    return sqrt(var);
+  } //StandardError()
+
+
+  /// @brief  Allocate storage for the sums from "num" more blocks
+  ///         (see SetErrorBlocks()), and return the index of the first one.
+  size_t NewErrorBlocks(size_t num) {
+    size_t b0 = vvCblock.size();
+    vvCblock.resize(b0 + num, vector<double>(L+1, 0.0));
+    vvNumBlock.resize(b0 + num, vector<size_t>(L+1, 0));
+    return b0;
+  }
+
+
+  /// @brief  Add the sums from block b (see SetErrorBlocks())
+  void AddBlockSums(size_t b,       //!< the block
+                    size_t j,       //!< the separation
+                    double C,       //!< Σ_i x(i)⋅x(i+j)  (in this block)
+                    size_t num_i)   //!< the number of terms in the sum
+  {
+    vvCblock[b][j] += C;
+    vvNumBlock[b][j] += num_i;
+  }
+
+
+  /// @brief  The first entry in segment s (when dividing N entries into
+  ///         num_seg segments of nearly equal length).
+  static size_t SegmentBegin(size_t N, size_t num_seg, size_t s) {
+    return (N * s) / num_seg;
+  }
+
+
+  /// @brief  The number of terms in Σ_i x(i)⋅x(i+j), considering only
+  ///         i_first <= i < i_last.
+  size_t NumTerms(size_t N, size_t j, size_t i_first, size_t i_last) const {
+    size_t num_i = is_periodic ? N : N-j;
+    if (num_i > i_last)
+      num_i = i_last;
+    return (num_i > i_first) ? num_i - i_first : 0;
+  }
+
+  /// @brief  The number of products x_d(i)*x_d(i+j) in the sums for
+  ///         j_begin <= j < j_end  (from a data set with N entries and
+  ///         D columns).  (See Profiler, ProgressReporter, and ChooseEngine().)
+  double NumProducts(size_t N, size_t D, size_t j_begin, size_t j_end) const {
+    double num_j = static_cast<double>(j_end - j_begin);
+    double num_i = num_j * N;
+    if (! is_periodic)
+      num_i -= 0.5 * num_j * (j_begin + j_end - 1.0); // Σ_j (N-j)
+    return num_i * D;
+  }
+
+
+  // The format of the files created by Save():
+  static constexpr char state_magic[16] = {'N','D','A','U','T','O','C','R',
+                                           'R',' ','S','U','M','S','\n','\0'};
+  static const uint64_t state_byte_order = 0x0102030405060708ULL;
+  static const uint64_t state_version = 1;
+
+  /// @brief  The settings which must agree when combining saved sums
+  uint64_t StateFlags() const {
+    return ((is_periodic     ? 1 : 0) |
+            (subtract_ave    ? 2 : 0) |
+            (report_rms      ? 4 : 0) |
+            (cross_all_pairs ? 8 : 0) |
+            (per_column      ? 16 : 0) |
+            (UsesCrossPairs() ? 32 : 0) |
+            (error_bars      ? 64 : 0) |
+            (jackknife       ? 128 : 0));
+  }
+
+  static void WriteInt(ostream &out, uint64_t n) {
+    out.write(reinterpret_cast<const char*>(&n), sizeof(n));
+  }
+
+  template<typename T>
+  static void WriteArray(ostream &out, const vector<T> &v) {
+    WriteInt(out, v.size());
+    for (size_t k=0; k < v.size(); k++) {
+      // (size_t entries are always stored using 64 bits)
+      typename conditional<is_integral<T>::value, uint64_t, double>::type x = v[k];
+      out.write(reinterpret_cast<const char*>(&x), sizeof(x));
+    }
+  }
+
+  static uint64_t ReadInt(istream &in, const string &err_prefix) {
+    uint64_t n;
+    in.read(reinterpret_cast<char*>(&n), sizeof(n));
+    if (! in)
+      throw InputErr(err_prefix + "The file is truncated.\n");
+    return n;
+  }
+
+  template<typename T>
+  static void ReadArray(istream &in, vector<T> &v, const string &err_prefix) {
+    uint64_t n = ReadInt(in, err_prefix);
+    if (n > (uint64_t(1) << 40))
+      throw InputErr(err_prefix + "The file is corrupted.\n");
+    v.resize(n);
+    for (size_t k=0; k < n; k++) {
+      typename conditional<is_integral<T>::value, uint64_t, double>::type x;
+      in.read(reinterpret_cast<char*>(&x), sizeof(x));
+      if (! in)
+        throw InputErr(err_prefix + "The file is truncated.\n");
+      v[k] = x;
+    }
+  }
+
+
   void Resize(size_t _L) {
     L = _L;
     vC.resize(L+1);
+    vCcomp.resize(L+1);
     vCrms.resize(L+1);
+    vCrmsComp.resize(L+1);
     vNumSamples.resize(L+1);
+    for (size_t p=0; p < vvCpair.size(); p++) {
+      vvCpair[p].resize(L+1);
+      vvCpairComp[p].resize(L+1);
+    }
+    for (size_t b=0; b < vvCblock.size(); b++) {
+      vvCblock[b].resize(L+1);
+      vvNumBlock[b].resize(L+1);
+    }
+  }
+
+
+  /// @brief  If all pairs of columns were requested, choose them now that
+  ///         the number of columns (D) is known.  Check that the pairs
+  ///         refer to columns which exist.
+  void ChoosePairs(size_t D)
+  {
+    if (! UsesCrossPairs())
+      return;
+    if (vPairs.empty()) {
+      for (size_t a=0; a < D; a++)
+        for (size_t b=0; b < D; b++)
+          if ((a == b) || (! per_column))
+            vPairs.push_back(make_pair(a, b));
+      vvCpair.assign(vPairs.size(), vector<double>(L+1, 0.0));
+      vvCpairComp = vvCpair;
+    }
+    for (size_t p=0; p < vPairs.size(); p++) {
+      if ((vPairs[p].first >= D) || (vPairs[p].second >= D)) {
+        stringstream err_msg;
+        err_msg << "Error: Cross-correlation requested between columns "
+                << vPairs[p].first+1 << " and " << vPairs[p].second+1 << ",\n"
+                << "       but the data only has " << D << " columns.\n";
+        throw InputErr(err_msg.str());
+      }
+    }
+  }
+
+
+  /// @brief  Choose how to divide the lags (0 <= j <= jmax) into blocks
+  ///         (and the i values into tiles) for a data set with N entries
+  ///         and D columns.  (See LagBlockSum().  Smaller blocks are used
+  ///         when there are not enough lags to keep all of the threads busy.)
+  LagTile ChooseLagBlocks(size_t N, size_t D, size_t jmax) const
+  {
+    LagTile tile = ChooseLagTile(N, D, sizeof(Scalar));
+    size_t num_threads = 1;
+    #ifndef DISABLE_OPENMP
+    if (parallelize_lags)
+      num_threads = omp_get_max_threads();
+    #endif
+    size_t max_block = (jmax + 4*num_threads) / (4*num_threads);
+    if (tile.j > max_block)
+      tile.j = (max_block > 0) ? max_block : 1;
+    return tile;
+  }
+
+
+  /// @brief  A rectangular part of the (i,j) triangle: the products
+  ///         x(i)⋅x(i+j) with j_begin <= j < j_end and i_first <= i < i_last
+  ///         (which belong to error block "seg").
+  struct LagTask {
+    size_t j_begin, j_end;
+    size_t i_first, i_last;
+    size_t seg;
+  };
+
+
+  /// @brief  Divide the products x(i)⋅x(i+j) (0 <= j <= jmax) from a data
+  ///         set with N entries and D columns into tasks which require a
+  ///         similar amount of computation.  The lags are divided into
+  ///         blocks (at most one tile wide, see LagBlockSum()), and each
+  ///         block is divided into pieces (along i).  In the non-periodic
+  ///         case, the blocks with small j contain more products (N-j per
+  ///         lag), so they are divided into more pieces (along i).
+  ///         The tasks do not depend on the number of threads (so neither
+  ///         do the results).  If num_seg > 1, the i values are also
+  ///         divided at the boundaries between error blocks (segments).
+  void PartitionLags(size_t N, size_t D, size_t jmax, size_t num_seg,
+                     const LagTile &tile, vector<LagTask> &vTasks) const
+  {
+    // Use enough tasks to keep many threads busy, but not so many
+    // that the overhead of each task (or the memory it needs) matters.
+    const size_t max_tasks = 512;
+    const double min_task_products = 1.0e6;
+    const size_t max_partial_entries = (1 << 20); // Σ_tasks (j_end-j_begin)
+    if (num_seg < 1)
+      num_seg = 1;
+
+    size_t width = min(min(tile.j, max_partial_entries / max_tasks), jmax+1);
+    size_t num_blocks = (jmax + width) / width;
+    double target = NumProducts(N, D, 0, jmax+1) / max_tasks;
+    if (target < min_task_products)
+      target = min_task_products;
+
+    // How many pieces should each block of lags be divided into?
+    vector<size_t> vPieces(num_blocks);
+    size_t num_entries = 0;
+    for (size_t b=0; b < num_blocks; b++) {
+      size_t j_begin = b * width;
+      size_t j_end = min(j_begin + width, jmax+1);
+      vPieces[b] = static_cast<size_t>(ceil(NumProducts(N, D, j_begin, j_end)
+                                            / target));
+      if (vPieces[b] < num_seg)
+        vPieces[b] = num_seg;
+      num_entries += vPieces[b] * (j_end - j_begin);
+    }
+    if (num_entries > max_partial_entries)
+      for (size_t b=0; b < num_blocks; b++)
+        vPieces[b] = max(num_seg, (vPieces[b] * max_partial_entries) / num_entries);
+
+    vTasks.clear();
+    for (size_t b=0; b < num_blocks; b++) {
+      size_t j_begin = b * width;
+      size_t j_end = min(j_begin + width, jmax+1);
+      size_t i_end = is_periodic ? N : N - j_begin; // (the longest row)
+      size_t piece = (i_end + vPieces[b] - 1) / vPieces[b];
+      if (piece < 1)
+        piece = 1;
+      for (size_t s=0; s < num_seg; s++) {
+        size_t seg_first = SegmentBegin(N, num_seg, s);
+        size_t seg_last = min(SegmentBegin(N, num_seg, s+1), i_end);
+        for (size_t i=seg_first; i < seg_last; i += piece) {
+          LagTask task;
+          task.j_begin = j_begin;
+          task.j_end = j_end;
+          task.i_first = i;
+          task.i_last = min(i + piece, seg_last);
+          task.seg = s;
+          vTasks.push_back(task);
+        }
+      }
+    }
+  } //PartitionLags()
+
+
+  /// @brief  The number of threads used for each data set
+  size_t NumThreads() const {
+    size_t num_threads = 1;
+    #ifndef DISABLE_OPENMP
+    if (parallelize_lags)
+      num_threads = omp_get_max_threads();
+    #endif
+    return num_threads;
+  }
+
+
+  /// @brief  Which engine should be used to compute C(j) (0 <= j <= jmax)
+  ///         for a data set with N entries and D columns?  (If engine is
+  ///         ENGINE_AUTO, choose the one which cost_model predicts is faster.
+  ///         Dividing the data set into num_seg > 1 blocks requires the
+  ///         direct engine.)
+  Engine ChooseEngine(size_t N, size_t D, size_t jmax, size_t num_seg) const
+  {
+    if (engine != ENGINE_AUTO)
+      return engine;
+    if ((num_seg > 1) || (N == 0))
+      return ENGINE_DIRECT;
+    double t_direct = cost_model.DirectCost(NumProducts(N, D, 0, jmax+1),
+                                            report_rms, NumThreads());
+    return (FFTCost(N, D) < t_direct) ? ENGINE_FFT : ENGINE_DIRECT;
+  }
+
+
+  /// @brief  If the cost model is only a guess (see SetCostModel()), keep
+  ///         track of the time the faster engine is predicted to need for
+  ///         these data sets (with a threshold, including every lag which
+  ///         might be needed).  Once this exceeds the time needed to measure
+  ///         the cost model, measure it (or read it from the cache file).
+  ///         (Until then, a wrong choice can not cost much time.)
+  ///         Invoke this before processing the data sets (and not from
+  ///         multiple threads).
+  template<typename T>
+  void PrepareCostModel(const vector<DataView<T> > &vX_n)
+  {
+    if ((engine != ENGINE_AUTO) || (pCalibrationLog == nullptr) ||
+        (! cost_model.source.empty()))
+      return;
+    for (size_t n=0; n < vX_n.size(); n++) {
+      size_t N = vX_n[n].size();
+      if (N == 0)
+        continue;
+      size_t jmax = (N-1 < L) ? N-1 : L;
+      if (threshold > -1.0)
+        jmax = is_periodic ? N/2 : N-1;
+      double t_direct = cost_model.DirectCost(NumProducts(N, vX_n[n].dim(),
+                                                          0, jmax+1),
+                                              report_rms, NumThreads());
+      guessed_cost += min(t_direct, FFTCost(N, vX_n[n].dim()));
+    }
+    if (guessed_cost >= EngineCostModel::min_calibration_cost)
+      cost_model = LoadCostModel(*pCalibrationLog);
+  }
+
+
+  /// @brief  The predicted time needed by the FFT engine to compute C(j)
+  ///         (and Crms(j), if requested) for a data set.  (See AccumulateFFT())
+  double FFTCost(size_t N, size_t D) const
+  {
+    double num_transforms = EngineCostModel::AutoTransforms(D);
+    if (report_rms)
+      num_transforms += EngineCostModel::AutoTransforms((D*(D+1))/2);
+    return cost_model.FFTCost(N, num_transforms);
+  }
+
+
+  /// @brief  Which engine should be used to compute the cross-correlations
+  ///         (vvCpair) for a data set?  (See ChooseEngine().)
+  Engine ChoosePairEngine(size_t N, size_t D, size_t jmax) const
+  {
+    if (engine != ENGINE_AUTO)
+      return engine;
+    size_t P = vPairs.size();
+    double t_direct = cost_model.DirectCost(NumProducts(N, P, 0, jmax+1),
+                                            false, NumThreads());
+    double t_fft = cost_model.FFTCost(N, EngineCostModel::CrossTransforms(D, P));
+    return (t_fft < t_direct) ? ENGINE_FFT : ENGINE_DIRECT;
+  }
+
+
+  /// @brief  Record which engine was used for a data set
+  void CountDataSet(Engine e) {
+    if (e == ENGINE_FFT)
+      num_fft_sets++;
+    else
+      num_direct_sets++;
+  }
+
+
+  /// @brief  Add the sums used to calculate the cross-correlations
+  ///         (vvCpair[p][j]) from a single data set, for 0 <= j <= jmax.
+  ///         (The data has already been copied into aX, as in AccumulateFFT.)
+  ///         Optionally, the sums for the pairs (a,a) are also added to
+  ///         (*paTrace)[j].
+  void
+  AccumulatePairs(const vector<Scalar> &aX, //!< x_d(i) = aX[d*ld+i]
+                  size_t N,    //!< the number of entries in the data set
+                  size_t ld,   //!< the length of each column in aX
+                  size_t D,    //!< the number of columns
+                  size_t jmax, //!< compute C_ab(j) for 0 <= j <= jmax
+                  vector<double> *paTrace = nullptr) //!< optional
+  {
+    size_t P = vPairs.size();
+    if ((P == 0) || (N == 0))
+      return;
+
+    vector<vector<double> > vvR;  // vvR[p][j] = Σ_i x_a(i)*x_b(i+j)
+
+    if (ChoosePairEngine(N, D, jmax) == ENGINE_FFT) {
+      // (The transform of each column is computed once and used by every
+      //  pair which contains it.)
+      double t_begin = pProfiler ? Profiler::Now() : 0.0;
+      CrossCorrelateFFT(N, D,
+                        [&](size_t d, size_t i) {
+                          return static_cast<double>(aX[d*ld + i]);
+                        },
+                        vPairs, jmax, is_periodic, vvR);
+      if (pProfiler)
+        pProfiler->AddKernelTime(Profiler::Now() - t_begin,
+                                 NumProducts(N, P, 0, jmax+1));
+    }
+    else {
+      // Each task computes the sums for one pair (for example, one column)
+      // and one block of lags.  (Different tasks update different entries
+      // of vvR, so the tasks can be processed in parallel.)
+      vvR.assign(P, vector<double>(jmax+1, 0.0));
+      LagTile tile = ChooseLagBlocks(N, 2, jmax);
+      size_t num_blocks = (jmax + tile.j) / tile.j;
+      size_t num_tasks = P * num_blocks;
+
+      #pragma omp parallel for schedule(dynamic) if (parallelize_lags)
+      for (size_t task=0; task < num_tasks; ++task)
+      {
+        size_t p = task / num_blocks;
+        size_t j_begin = (task % num_blocks) * tile.j;
+        size_t j_end = j_begin + tile.j;  // (one past the last j)
+        if (j_end > jmax+1)
+          j_end = jmax+1;
+        double t_begin = pProfiler ? Profiler::Now() : 0.0;
+        CrossBlockSum(&aX[vPairs[p].first * ld], &aX[vPairs[p].second * ld],
+                      N, is_periodic, j_begin, j_end, tile.i,
+                      &vvR[p][j_begin]);
+        if (pProfiler)
+          pProfiler->AddKernelTime(Profiler::Now() - t_begin,
+                                   NumProducts(N, 1, j_begin, j_end));
+      }
+    }
+
+    for (size_t p=0; p < P; p++) {
+      for (size_t j=0; j <= jmax; j++) {
+        CompensatedAdd(vvCpair[p][j], vvCpairComp[p][j], vvR[p][j]);
+        if (paTrace && (vPairs[p].first == vPairs[p].second))
+          (*paTrace)[j] += vvR[p][j];
+      }
+    }
+  } //AccumulatePairs()
+
+
+  /// @brief  Add the sums computed from one data set (or part of one)
+  ///         to vC[j] and vCrms[j] (using compensated summation).
+  void AddSums(size_t j,       //!< the separation
+               double C,       //!< Σ_i x(i)⋅x(i+j)
+               double Csq,     //!< Σ_i (x(i)⋅x(i+j))^2  (if report_rms)
+               size_t num_i)   //!< the number of terms in these sums
+  {
+    CompensatedAdd(vC[j], vCcomp[j], C);
+    if (report_rms)
+      CompensatedAdd(vCrms[j], vCrmsComp[j], Csq);
+    vNumSamples[j] += num_i;
+  }
+
+
+  /// @brief  Add the sums from the most recent entries (in PushFrame())
+  ///         to the totals for the current data set.
+  void FlushStreamBlock(size_t num_frames) //!< (entries since the last flush)
+  {
+    size_t W = L+1;
+    for (size_t j=0; j < W; ++j) {
+      CompensatedAdd(aStreamR[j], aStreamRcomp[j], aStreamBlockR[j]);
+      aStreamBlockR[j] = 0.0;
+      if (report_rms) {
+        CompensatedAdd(aStreamRsq[j], aStreamRsqComp[j], aStreamBlockRsq[j]);
+        aStreamBlockRsq[j] = 0.0;
+      }
+    }
+    if (pProgress) {
+      // (The length of the data set is not known in advance, so the work
+      //  is reported after it was done.  Each entry used min(i,L)+1 lags.)
+      double work = static_cast<double>(num_frames) * min(stream_N, W) * stream_D;
+      pProgress->AddWork(work);
+      pProgress->AddDone(work);
+    }
   }
 
   /// @brief  Choose the domain of the correlation function
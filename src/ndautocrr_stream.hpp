@@ -0,0 +1,123 @@
+///   @file ndautocrr_stream.hpp
+///   @brief  A minimal interface for computing the correlation function
+///           from inside another program (for example, a simulation),
+///           one frame at a time, as the frames are produced.
+///
+///   Example:
+///
+///   NdAutocrrStream<double> acf(1000);   // (compute C(j) for 0 <= j <= 1000)
+///   acf.begin_series(3);                 // (each frame has 3 numbers)
+///   for (long step=0; step < num_steps; step++) {
+///     ... update the simulation ...
+///     acf.push(x);                       // (x is a pointer to 3 doubles)
+///   }
+///   acf.end_series();
+///   const AutocrrResult &r = acf.result(); // (r.C[j] stores C(j))
+///
+///   This file only depends on ndautocrr.hpp (and the files it includes).
+///   It does not use any global variables (such as the ones in io.hpp).
+
+#ifndef _NDAUTOCRR_STREAM_HPP
+#define _NDAUTOCRR_STREAM_HPP
+
+#include <vector>
+using namespace std;
+#include "err.hpp"
+#include "ndautocrr.hpp"
+
+
+
+/// @brief  The correlation function (and related quantities) reported by
+///         NdAutocrrStream::result()
+struct AutocrrResult {
+  vector<double> C;           //!< C[j] = ⟨(x(i)-⟨x⟩)⋅(x(i+j)-⟨x⟩)⟩
+  vector<size_t> num_samples; //!< the number of terms averaged in C[j]
+  double correlation_length;  //!< see NdAutocrr::GuessCorrelationLength()
+
+  AutocrrResult():correlation_length(0.0) {}
+};
+
+
+
+/// @brief  Compute the correlation function from one or more data sets
+///         ("series"), each of which is supplied one frame at a time.
+///         All of the memory is allocated in begin_series(), so push()
+///         does not allocate memory.  Each push() requires O(L*D) time.
+///         Different objects are independent of each other (so several
+///         correlation functions can be computed at the same time).
+
+template<typename Scalar>
+
+class NdAutocrrStream {
+
+  size_t L;
+  double threshold;
+  bool subtract_ave;
+  NdAutocrr<Scalar> sums;  // the (un-normalized) sums accumulated so far
+  AutocrrResult cached;    // the most recent result() (if up_to_date)
+  bool up_to_date;         // is "cached" consistent with "sums"?
+
+public:
+
+  NdAutocrrStream(size_t _L, //!< compute C(j) for 0 <= j <= L
+                  bool _subtract_ave = true, //!< subtract ⟨x⟩ from x(i)?
+                  double _threshold = -1.01  //!< (used by correlation_length)
+                  ):
+    L(_L),
+    threshold(_threshold),
+    subtract_ave(_subtract_ave),
+    sums(_threshold, _L, false, _subtract_ave),
+    up_to_date(false)
+  {
+    if (L == 0)
+      throw InputErr("Error: NdAutocrrStream requires L > 0.\n");
+  }
+
+  /// @brief  Begin a new (independent) data set.  Each frame contains
+  ///         D numbers.  (This allocates memory proportional to L*D.)
+  void begin_series(size_t D) {
+    sums.BeginSeries(D);
+    up_to_date = false;
+  }
+
+  /// @brief  Add the next frame, x(i) (an array of D numbers).
+  ///         The contents are copied, so the caller may reuse the array.
+  void push(const Scalar *frame) {
+    sums.PushFrame(frame);
+  }
+
+  /// @brief  Finish the current data set.  (Only completed data sets
+  ///         contribute to result().)
+  void end_series() {
+    sums.EndSeries();
+    up_to_date = false;
+  }
+
+  /// @brief  Was begin_series() invoked (without end_series())?
+  bool in_series() const { return sums.SeriesStarted(); }
+
+  /// @brief  Return the correlation function, averaged over all of the
+  ///         data sets completed so far.  This can be invoked at any time
+  ///         (more data can be added afterwards).
+  const AutocrrResult &result() {
+    if (up_to_date)
+      return cached;
+    // Normalize a copy of the sums (so that the originals can be extended)
+    NdAutocrr<Scalar> copy(threshold, L, false, subtract_ave);
+    copy.Merge(sums);
+    copy.Finalize();
+    cached.C.assign(copy.vC.begin(), copy.vC.begin() + L+1);
+    cached.num_samples.assign(copy.vNumSamples.begin(),
+                              copy.vNumSamples.begin() + L+1);
+    cached.correlation_length = ((copy.vNumSamples[0] > 0)
+                                 ? copy.GuessCorrelationLength()
+                                 : 0.0);
+    up_to_date = true;
+    return cached;
+  }
+
+}; //class NdAutocrrStream
+
+
+
+#endif //#ifndef _NDAUTOCRR_STREAM_HPP
@@ -0,0 +1,207 @@
+///   @file output.hpp
+///   @brief  Print the correlation function (quickly), either as text or as
+///           a NumPy ".npy" file, optionally omitting some of the lags.
+///           (See the "-outnpy", "-outstride", and "-outlog" arguments.)
+
+#ifndef _OUTPUT_HPP
+#define _OUTPUT_HPP
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <charconv>
+#include <cmath>
+#include <cassert>
+#include "err.hpp"
+#include "binary_io.hpp"
+using namespace std;
+
+
+
+/// @brief  A TextWriter formats numbers using std::to_chars() and writes
+///         them to an ostream in large blocks.  (This is much faster than
+///         invoking "operator<<" for each number.)  The numbers are printed
+///         the same way "operator<<" prints them using the same precision.
+
+class TextWriter {
+
+  ostream &out;
+  vector<char> aBuf;  // the characters which have not been written yet
+  size_t end;         // the number of characters stored in aBuf
+  int precision;      // the number of significant digits
+
+  // (The longest number printed requires fewer than this many characters.)
+  static const size_t max_number_length = 64;
+
+public:
+
+  TextWriter(ostream &_out,         //!< write the text here
+             int _precision = 14,   //!< significant digits (like "%.14g")
+             size_t buffer_size = (1 << 16)):
+    out(_out),
+    aBuf(buffer_size + max_number_length),
+    end(0),
+    precision(_precision)
+  { }
+
+  ~TextWriter() { Flush(); }
+
+  /// @brief  Print a single character
+  void Put(char c) {
+    aBuf[end++] = c;
+    if (end >= aBuf.size() - max_number_length)
+      Flush();
+  }
+
+  /// @brief  Print a floating point number
+  void Write(double x) {
+    to_chars_result r = to_chars(&aBuf[end], &aBuf[0] + aBuf.size(), x,
+                                 chars_format::general, precision);
+    end = r.ptr - &aBuf[0];
+    if (end >= aBuf.size() - max_number_length)
+      Flush();
+  }
+
+  /// @brief  Print a non-negative integer
+  void Write(size_t n) {
+    to_chars_result r = to_chars(&aBuf[end], &aBuf[0] + aBuf.size(), n);
+    end = r.ptr - &aBuf[0];
+    if (end >= aBuf.size() - max_number_length)
+      Flush();
+  }
+
+  /// @brief  Write the characters stored in the buffer to the ostream
+  void Flush() {
+    if (end > 0)
+      out.write(&aBuf[0], end);
+    end = 0;
+  }
+
+}; //class TextWriter
+
+
+
+/// @brief  Write a 2-dimensional array of float64 numbers (N rows and
+///         D columns, stored in row-major order) in NumPy ".npy" format.
+inline void
+WriteNpyArray(ostream &out,
+              const vector<double> &aData, //!< aData[i*D+d] is row i, column d
+              size_t N,   //!< the number of rows
+              size_t D)   //!< the number of columns
+{
+  assert(aData.size() == N*D);
+  stringstream header;
+  header << "{'descr': '" << (IsLittleEndian() ? '<' : '>') << "f8', "
+         << "'fortran_order': False, 'shape': (" << N << ", " << D << "), }";
+  // The header is padded with spaces (and ends with a newline), so that
+  // the data begins at a multiple of 64 bytes.  (See the NumPy format.)
+  string header_str = header.str();
+  const size_t preamble_len = 10;  // magic string, version, header length
+  size_t header_len = header_str.size() + 1;
+  header_len += (64 - (preamble_len + header_len) % 64) % 64;
+  header_str.resize(header_len - 1, ' ');
+  header_str += '\n';
+  out.write("\x93NUMPY\x01\x00", 8);
+  char aLen[2] = {static_cast<char>(header_len & 0xff),
+                  static_cast<char>((header_len >> 8) & 0xff)};
+  out.write(aLen, 2);
+  out.write(header_str.data(), header_len);
+  if (N*D > 0)
+    out.write(reinterpret_cast<const char*>(aData.data()),
+              N * D * sizeof(double));
+}
+
+
+
+/// @brief  Choose which lags (0 <= j <= jmax) to print.
+///         If points_per_decade > 0, choose lags which are (roughly) evenly
+///         spaced on a logarithmic scale (rounded to the nearest integer,
+///         and discarding duplicates).  Otherwise print every stride'th lag.
+///         (Lag 0 is always included.)
+inline vector<size_t>
+ChooseOutputLags(size_t jmax,
+                 size_t stride = 1,              //!< print every stride'th j
+                 double points_per_decade = 0.0) //!< (0 means use "stride")
+{
+  vector<size_t> vLags;
+  vLags.push_back(0);
+  if (points_per_decade > 0.0) {
+    for (size_t k=0; true; k++) {
+      double j = round(pow(10.0, k / points_per_decade));
+      if (j > jmax)
+        break;
+      if (static_cast<size_t>(j) > vLags.back())
+        vLags.push_back(static_cast<size_t>(j));
+    }
+  }
+  else {
+    assert(stride > 0);
+    for (size_t j=stride; j <= jmax; j+=stride)
+      vLags.push_back(j);
+  }
+  return vLags;
+}
+
+
+
+/// @brief  Print a table of results.  Each row contains a lag, followed by
+///         one number from each column (and, optionally, the number of
+///         samples).  Rows with no samples are omitted.  The table is printed
+///         as text to "out", or (if npy_filename is not empty) it is saved
+///         in a ".npy" file instead (with all of the numbers stored as float64).
+///         Returns the number of rows.
+inline size_t
+WriteTable(ostream &out,
+           const vector<size_t> &vRows, //!< which rows to print (in order)
+           const vector<size_t> *pvLag, //!< the lag of each row (nullptr: lag = row)
+           const vector<const vector<double>*> &vpColumns, //!< the numbers
+           const vector<size_t> &vNumSamples, //!< the number of samples in each row
+           bool report_nsum,            //!< print the number of samples?
+           const string &npy_filename = "") //!< save the table here instead?
+{
+  size_t num_rows = 0;
+  if (npy_filename.empty()) {
+    TextWriter writer(out);
+    for (size_t r : vRows) {
+      if (vNumSamples[r] == 0)
+        continue;
+      writer.Write(pvLag ? (*pvLag)[r] : r);
+      for (size_t c=0; c < vpColumns.size(); c++) {
+        writer.Put(' ');
+        writer.Write((*vpColumns[c])[r]);
+      }
+      if (report_nsum) {
+        writer.Put(' ');
+        writer.Write(vNumSamples[r]);
+      }
+      writer.Put('\n');
+      num_rows++;
+    }
+  }
+  else {
+    size_t num_cols = 1 + vpColumns.size() + (report_nsum ? 1 : 0);
+    vector<double> aData;
+    for (size_t r : vRows) {
+      if (vNumSamples[r] == 0)
+        continue;
+      aData.push_back(pvLag ? (*pvLag)[r] : r);
+      for (size_t c=0; c < vpColumns.size(); c++)
+        aData.push_back((*vpColumns[c])[r]);
+      if (report_nsum)
+        aData.push_back(vNumSamples[r]);
+      num_rows++;
+    }
+    ofstream npy_file(npy_filename.c_str(), ios::binary);
+    if (! npy_file)
+      throw InputErr("Error: Unable to create file \"" + npy_filename + "\"\n");
+    WriteNpyArray(npy_file, aData, num_rows, num_cols);
+    if (! npy_file)
+      throw InputErr("Error: Unable to write to file \"" + npy_filename + "\"\n");
+  }
+  return num_rows;
+} //WriteTable()
+
+
+
+#endif //#ifndef _OUTPUT_HPP
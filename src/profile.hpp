@@ -0,0 +1,197 @@
+///   @file profile.hpp
+///   @brief  Keep track of the time spent in each phase of the calculation
+///           (and by each thread), so that slow runs can be diagnosed.
+///           (See the "--profile" argument.)
+
+#ifndef _PROFILE_HPP
+#define _PROFILE_HPP
+
+#include <vector>
+#include <string>
+#include <iostream>
+#include <chrono>
+#include <sys/resource.h>
+#ifndef DISABLE_OPENMP
+#include <omp.h>
+#endif
+using namespace std;
+
+
+
+/// @brief  A Profiler stores the (wall clock) time spent in each phase of
+///         the calculation, and the time that each thread spent copying the
+///         data and computing the correlation sums.  The per-thread
+///         functions (AddCopyTime(), AddKernelTime()) may be invoked from
+///         inside parallel regions.  (The other functions may not.)
+
+class Profiler {
+
+  vector<string> vPhaseNames;  // the name of each phase (in order)
+  vector<double> vPhaseTimes;  // the time spent in each phase (in seconds)
+
+  // statistics for each thread
+  // (Each thread's entry is padded to a separate cache line.)
+  static const size_t stride = 8;
+  vector<double> aCopyTime;    // time spent copying (and shifting) the data
+  vector<double> aKernelTime;  // time spent computing the sums
+  vector<double> aProducts;    // the number of products x_d(i)*x_d(i+j)
+
+  // statistics from the parser
+  double parse_bytes;
+  double parse_values;
+  double parse_time;
+
+public:
+
+  Profiler():parse_bytes(0.0), parse_values(0.0), parse_time(0.0) {
+    size_t num_threads = 1;
+    #ifndef DISABLE_OPENMP
+    num_threads = omp_get_max_threads();
+    #endif
+    aCopyTime.assign(num_threads * stride, 0.0);
+    aKernelTime.assign(num_threads * stride, 0.0);
+    aProducts.assign(num_threads * stride, 0.0);
+  }
+
+  /// @brief  Return the current time (in seconds)
+  static double Now() {
+    return chrono::duration<double>(chrono::steady_clock::now()
+                                    .time_since_epoch()).count();
+  }
+
+  /// @brief  Return the peak memory usage of this process (in bytes)
+  static double PeakMemory() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+      return 0.0;
+    #ifdef __APPLE__
+    return usage.ru_maxrss;           // (bytes)
+    #else
+    return usage.ru_maxrss * 1024.0;  // (kilobytes)
+    #endif
+  }
+
+  /// @brief  Add to the time spent in a phase (named "name")
+  void AddPhase(const string &name, double seconds) {
+    for (size_t k=0; k < vPhaseNames.size(); k++) {
+      if (vPhaseNames[k] == name) {
+        vPhaseTimes[k] += seconds;
+        return;
+      }
+    }
+    vPhaseNames.push_back(name);
+    vPhaseTimes.push_back(seconds);
+  }
+
+  /// @brief  Return the time spent in a phase (named "name")
+  double PhaseTime(const string &name) const {
+    for (size_t k=0; k < vPhaseNames.size(); k++)
+      if (vPhaseNames[k] == name)
+        return vPhaseTimes[k];
+    return 0.0;
+  }
+
+  /// @brief  Record the amount of text parsed (and how long it took)
+  void AddParsed(double bytes, double values, double seconds) {
+    parse_bytes += bytes;
+    parse_values += values;
+    parse_time += seconds;
+  }
+
+  /// @brief  Add to the time the current thread spent copying the data
+  void AddCopyTime(double seconds) {
+    aCopyTime[Slot()] += seconds;
+  }
+
+  /// @brief  Add to the time the current thread spent computing the sums
+  ///         (and the number of products x_d(i)*x_d(i+j) it computed)
+  void AddKernelTime(double seconds, double num_products) {
+    size_t s = Slot();
+    aKernelTime[s] += seconds;
+    aProducts[s] += num_products;
+  }
+
+  /// @brief  Print a summary (in human readable form)
+  void Report(ostream &out) const {
+    out << "#------------- profile -------------\n";
+    double total = 0.0;
+    for (size_t k=0; k < vPhaseNames.size(); k++) {
+      out << "# " << vPhaseNames[k] << ": " << vPhaseTimes[k] << " s\n";
+      total += vPhaseTimes[k];
+    }
+    out << "# total: " << total << " s\n";
+    if (parse_time > 0.0)
+      out << "# parsing: " << parse_bytes / 1.0e6 / parse_time << " MB/s, "
+          << parse_values / parse_time << " numbers/s\n";
+    double copy = 0.0, kernel = 0.0, products = 0.0, busy_max = 0.0;
+    size_t num_threads = aKernelTime.size() / stride;
+    for (size_t t=0; t < num_threads; t++) {
+      copy += aCopyTime[t*stride];
+      kernel += aKernelTime[t*stride];
+      products += aProducts[t*stride];
+      busy_max = max(busy_max, aCopyTime[t*stride] + aKernelTime[t*stride]);
+    }
+    if (copy + kernel > 0.0) {
+      out << "# copying data (and subtracting the average): " << copy
+          << " s (summed over threads)\n"
+          << "# computing the sums: " << kernel << " s (summed over threads)\n";
+      if (kernel > 0.0)
+        out << "# products x(i)*x(i+j) per second: " << products / kernel
+            << " (per thread)\n";
+      double t_accumulate = PhaseTime("accumulate");
+      if (t_accumulate > 0.0)
+        out << "# products x(i)*x(i+j) per second: " << products / t_accumulate
+            << " (during the \"accumulate\" phase)\n";
+      out << "# busy time per thread:";
+      for (size_t t=0; t < num_threads; t++)
+        out << " " << aCopyTime[t*stride] + aKernelTime[t*stride];
+      out << " s\n";
+      if (busy_max > 0.0)
+        out << "# load balance (average/maximum busy time): "
+            << (copy + kernel) / (num_threads * busy_max) << "\n";
+    }
+    out << "# peak memory: " << PeakMemory() / 1.0e6 << " MB\n"
+        << "#-----------------------------------" << endl;
+  }
+
+  /// @brief  Print the same information in JSON format
+  void WriteJSON(ostream &out) const {
+    streamsize old_precision = out.precision(12);
+    out << "{\n  \"phases\": {";
+    for (size_t k=0; k < vPhaseNames.size(); k++)
+      out << (k > 0 ? ", " : "") << "\"" << vPhaseNames[k] << "\": "
+          << vPhaseTimes[k];
+    out << "},\n"
+        << "  \"parse_bytes\": " << parse_bytes
+        << ", \"parse_values\": " << parse_values
+        << ", \"parse_s\": " << parse_time << ",\n";
+    size_t num_threads = aKernelTime.size() / stride;
+    out << "  \"threads\": [";
+    for (size_t t=0; t < num_threads; t++)
+      out << (t > 0 ? ",\n              " : "")
+          << "{\"copy_s\": " << aCopyTime[t*stride]
+          << ", \"kernel_s\": " << aKernelTime[t*stride]
+          << ", \"products\": " << aProducts[t*stride] << "}";
+    out << "],\n"
+        << "  \"peak_memory_bytes\": " << PeakMemory() << "\n}\n";
+    out.precision(old_precision);
+  }
+
+private:
+
+  /// @brief  The location of the current thread's statistics
+  size_t Slot() const {
+    size_t t = 0;
+    #ifndef DISABLE_OPENMP
+    t = omp_get_thread_num();
+    #endif
+    if (t*stride >= aKernelTime.size())
+      t = 0;
+    return t * stride;
+  }
+
+}; //class Profiler
+
+
+
+#endif //#ifndef _PROFILE_HPP
@@ -0,0 +1,197 @@
+///   @file progress.hpp
+///   @brief  Periodically report how much of the calculation is finished
+///           (and estimate how long the remainder will take).
+///           (See the "-progress" argument.)
+
+#ifndef _PROGRESS_HPP
+#define _PROGRESS_HPP
+
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+#include <cmath>
+using namespace std;
+
+
+
+/// @brief  A ProgressReporter keeps track of the amount of work which has
+///         been finished (using atomic counters which the threads doing the
+///         work increment once per task), and a separate thread prints a
+///         summary every few seconds (percent complete, throughput, and the
+///         estimated time remaining).
+///         The work is measured in units of products x_d(i)*x_d(i+j).
+///         The total amount of work is not known in advance when the data
+///         is read in batches (or streamed).  In that case, the fraction of
+///         the input file which has been read is also taken into account
+///         (if SetInputSize() was invoked).  If the size of the input is
+///         not known either (SetTotalUnknown()), only the amount of work
+///         finished so far (and the throughput) is reported.
+
+class ProgressReporter {
+
+  atomic<uint64_t> work_total;   // the work requested so far
+  atomic<uint64_t> work_done;    // the work finished so far
+  atomic<uint64_t> bytes_read;   // how much of the input file was read?
+  uint64_t bytes_total;          // the size of the input file (0 if unknown)
+  bool total_unknown;            // is the total amount of work unknown?
+
+  ostream &out;
+  double interval;               // (seconds)
+  double t_start;
+
+  // The reporter thread (and the variables used to stop it)
+  thread reporter;
+  mutex stop_mutex;
+  condition_variable stop_cv;
+  bool stop;
+  bool stop_quietly;             // (omit the final report?)
+
+public:
+
+  ProgressReporter(ostream &_out, //!< print the progress here
+                   double _interval = 10.0 //!< seconds between reports
+                   ):
+    work_total(0),
+    work_done(0),
+    bytes_read(0),
+    bytes_total(0),
+    total_unknown(false),
+    out(_out),
+    interval(_interval),
+    t_start(Now()),
+    stop(true),
+    stop_quietly(false)
+  { }
+
+  // (If the reporter is still running, for example because an exception
+  //  was thrown, then stop it without claiming that the work is finished.)
+  ~ProgressReporter() { Stop(true); }
+
+  /// @brief  Begin printing the progress (using a separate thread)
+  void Start() {
+    if (! stop)
+      return;
+    stop = false;
+    t_start = Now();
+    reporter = thread([this]() { Run(); });
+  }
+
+  /// @brief  Stop the reporter thread (after printing a final report,
+  ///         unless quietly==true)
+  void Stop(bool quietly = false) {
+    if (stop)
+      return;
+    {
+      lock_guard<mutex> lock(stop_mutex);
+      stop = true;
+      stop_quietly = quietly;
+    }
+    stop_cv.notify_all();
+    reporter.join();
+  }
+
+  /// @brief  The size of the input file (if known) in bytes
+  void SetInputSize(uint64_t num_bytes) { bytes_total = num_bytes; }
+
+  /// @brief  The total amount of work can not be estimated in advance
+  ///         (for example, when reading from the standard input)
+  void SetTotalUnknown() { total_unknown = true; }
+
+  /// @brief  How much of the input file has been read so far (in bytes)
+  void SetBytesRead(uint64_t num_bytes) {
+    bytes_read.store(num_bytes, memory_order_relaxed);
+  }
+
+  /// @brief  Add to the total amount of work (before it is started)
+  void AddWork(double num_products) {
+    work_total.fetch_add(static_cast<uint64_t>(num_products),
+                         memory_order_relaxed);
+  }
+
+  /// @brief  Discard work which will not be needed after all
+  ///         (for example, when the correlation function was truncated)
+  void RemoveWork(double num_products) {
+    work_total.fetch_sub(static_cast<uint64_t>(num_products),
+                         memory_order_relaxed);
+  }
+
+  /// @brief  Record that some of the work has been finished
+  ///         (This may be invoked by any thread.)
+  void AddDone(double num_products) {
+    work_done.fetch_add(static_cast<uint64_t>(num_products),
+                        memory_order_relaxed);
+  }
+
+private:
+
+  static double Now() {
+    return chrono::duration<double>(chrono::steady_clock::now()
+                                    .time_since_epoch()).count();
+  }
+
+  /// @brief  Print "h:mm:ss"
+  static string FormatTime(double seconds) {
+    long s = static_cast<long>(seconds + 0.5);
+    stringstream ss;
+    ss << s / 3600 << ":"
+       << (s / 60) % 60 / 10 << (s / 60) % 10 << ":"
+       << (s % 60) / 10 << s % 10;
+    return ss.str();
+  }
+
+  /// @brief  Print the progress so far (as a single line)
+  void Report(bool final) {
+    double elapsed = Now() - t_start;
+    double total = work_total.load(memory_order_relaxed);
+    double done = work_done.load(memory_order_relaxed);
+    if (done > total)
+      done = total;
+    // Estimate the fraction of the calculation which is finished
+    double fraction = 0.0;
+    if (total > 0.0)
+      fraction = done / total;
+    if (bytes_total > 0)
+      fraction = ((total > 0.0) ? fraction : 1.0) *
+        (static_cast<double>(bytes_read.load(memory_order_relaxed)) / bytes_total);
+    if (final)
+      fraction = 1.0;
+    stringstream ss;
+    ss << "# progress: ";
+    if (total_unknown && (! final))
+      ss << done << " products";
+    else {
+      ss.precision(1);
+      ss << fixed << 100.0 * fraction << "%";
+      ss.unsetf(ios_base::floatfield);
+    }
+    ss.precision(3);
+    if ((elapsed > 0.0) && (done > 0.0))
+      ss << " (" << done / elapsed << " products/s)";
+    ss << "  elapsed " << FormatTime(elapsed);
+    if ((! final) && (! total_unknown) && (fraction > 0.0))
+      ss << "  remaining " << FormatTime(elapsed * (1.0 - fraction) / fraction);
+    ss << "\n";
+    out << ss.str() << flush;  // (print the entire line at once)
+  }
+
+  /// @brief  The reporter thread
+  void Run() {
+    unique_lock<mutex> lock(stop_mutex);
+    while (! stop_cv.wait_for(lock, chrono::duration<double>(interval),
+                              [this]() { return stop; }))
+      Report(false);
+    if (! stop_quietly)
+      Report(true);
+  }
+
+}; //class ProgressReporter
+
+
+
+#endif //#ifndef _PROGRESS_HPP
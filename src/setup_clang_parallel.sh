@@ -11,10 +11,10 @@ export ANSI_C="clang"
 export ANSI_CPP="clang++"
 export L_COMP="ar rs"
 
-export LFLAGS="-fopenmp"  #-static
+export LFLAGS="-fopenmp -pthread"  #-static
 
-export MY_FLAGS="-std=c++11 -O3 -DNDEBUG -ffast-math"
-export CFLAGS="-c $MY_FLAGS -fopenmp"
+export MY_FLAGS="-std=c++17 -O3 -DNDEBUG -ffast-math"
+export CFLAGS="-c $MY_FLAGS -fopenmp -pthread"
 export CPP_PRELINKER_COMMAND="echo"
 export COMPILER_TEMP_FILES=""
 export LINKER_TEMP_FILES=""
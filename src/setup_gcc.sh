@@ -4,10 +4,10 @@ export ANSI_C="gcc"
 export ANSI_CPP="g++"
 export L_COMP="ar rs"
 
-export LFLAGS=""  #-static
+export LFLAGS="-pthread"  #-static
 
-export MY_FLAGS="-std=c++11 -O3 -DNDEBUG -ffast-math -DDISABLE_OPENMP"
-export CFLAGS="-c $MY_FLAGS"
+export MY_FLAGS="-std=c++17 -O3 -DNDEBUG -ffast-math -DDISABLE_OPENMP"
+export CFLAGS="-c $MY_FLAGS -pthread"
 export CPP_PRELINKER_COMMAND="echo"
 export COMPILER_TEMP_FILES=""
 export LINKER_TEMP_FILES=""
@@ -5,11 +5,11 @@ export ANSI_CPP="g++"
 export L_COMP="ar rs"
 
 #export LFLAGS="-static"          
-export LFLAGS="-fopenmp"  #-static
+export LFLAGS="-fopenmp -pthread"  #-static
 
-#export MY_FLAGS="-std=c++11 -g3 -O0 -DDISABLE_OPENMP"
-export MY_FLAGS="-std=c++11 -g3 -O0"
-export CFLAGS="-c $MY_FLAGS"
+#export MY_FLAGS="-std=c++17 -g3 -O0 -DDISABLE_OPENMP"
+export MY_FLAGS="-std=c++17 -g3 -O0"
+export CFLAGS="-c $MY_FLAGS -pthread"
 export CPP_PRELINKER_COMMAND="echo"
 export COMPILER_TEMP_FILES=""
 export LINKER_TEMP_FILES=""